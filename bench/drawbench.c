@@ -0,0 +1,501 @@
+// Benchmark the draw-call overhead of the tiledrawer. The visible tile set for
+// a camera pose is drawn with one instanced draw call, and with one draw call
+// per tile, in an offscreen EGL context without a window system.
+//
+// Usage: drawbench [-d distance] [-t tilt] [-s size] [-n frames]
+//
+// It also compares the visible tile sets and the time taken by the GPU and
+// the CPU implementations of the tilepicker, and by the GPU implementation at
+// several sampling densities.
+//
+// Finally it compares the render thread time per frame while a batch of tiles
+// is uploaded by the render thread, and by loader threads with shared
+// contexts. Loader uploads are checked by reading the textures back.
+//
+// Last, it times the creation of all programs with a cold and a warm program
+// binary cache. The cache lives in a temporary directory for the duration of
+// the benchmark.
+//
+// The default viewport is small, so that rasterization does not hide the
+// per-call overhead on software renderers.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <GL/gl.h>
+
+#include "../camera.h"
+#include "../headless/context.h"
+#include "../globe.h"
+#include "../glshare.h"
+#include "../programs.h"
+#include "../texture_cache.h"
+#include "../tiledrawer.h"
+#include "../tilepicker.h"
+#include "../util.h"
+#include "../viewport.h"
+
+static double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Draw the visible set once, return the number of tiles drawn:
+static size_t
+frame (const struct texture_cache *tex)
+{
+	size_t n = 0;
+
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	tiledrawer_start();
+
+	for (const struct tilepicker *t = tilepicker_first(); t; t = tilepicker_next(), n++) {
+		struct texture_cache tile = *tex;
+		const struct cache_node node = {
+			.x    = t->x,
+			.y    = t->y,
+			.zoom = t->zoom,
+		};
+
+		globe_map_tile(&node, &tile.coords);
+		tiledrawer(&(struct tiledrawer) {
+			.tile = &node,
+			.tex  = &tile,
+		});
+	}
+
+	tiledrawer_end();
+	return n;
+}
+
+// Visible tile set of a tilepicker implementation:
+struct set {
+	struct tilepicker tile[2000];
+	size_t used;
+};
+
+static void
+collect (struct set *set)
+{
+	set->used = 0;
+
+	for (const struct tilepicker *t = tilepicker_first(); t && set->used < NELEM(set->tile); t = tilepicker_next())
+		set->tile[set->used++] = *t;
+}
+
+// Check whether a tile, one of its ancestors or one of its descendants is in
+// the set, in other words whether the set draws something at its location:
+static bool
+covered (const struct set *set, const struct tilepicker *t)
+{
+	FOREACH_NELEM (set->tile, set->used, s) {
+		const uint32_t shift = s->zoom > t->zoom ? s->zoom - t->zoom : t->zoom - s->zoom;
+
+		if (s->zoom > t->zoom && (s->x >> shift) == t->x && (s->y >> shift) == t->y)
+			return true;
+
+		if (s->zoom <= t->zoom && (t->x >> shift) == s->x && (t->y >> shift) == s->y)
+			return true;
+	}
+
+	return false;
+}
+
+static bool
+contains (const struct set *set, const struct tilepicker *t)
+{
+	FOREACH_NELEM (set->tile, set->used, s)
+		if (s->x == t->x && s->y == t->y && s->zoom == t->zoom)
+			return true;
+
+	return false;
+}
+
+// Time the recalculation of the visible set, including the readback:
+static double
+pick (const enum tilepicker_mode mode, const int frames, struct set *set)
+{
+	const struct viewport *vp = viewport_get();
+	const struct camera *cam = camera_get();
+
+	tilepicker_set_mode(mode);
+
+	const double start = now();
+
+	for (int i = 0; i < frames; i++) {
+		tilepicker_recalc(vp, cam);
+
+		while (tilepicker_update())
+			continue;
+	}
+
+	const double elapsed = (now() - start) / frames;
+
+	collect(set);
+	return elapsed;
+}
+
+static void
+compare (const int frames)
+{
+	static struct set set[2];
+	static const char *name[2] = { "gpu", "cpu" };
+	double elapsed[2];
+
+	elapsed[0] = pick(TILEPICKER_GPU, frames, &set[0]);
+	elapsed[1] = pick(TILEPICKER_CPU, frames, &set[1]);
+
+	printf("\n%-10s %8s %10s %10s %12s\n", "picker", "tiles", "exact", "covered", "ms/pick");
+
+	for (int i = 0; i < 2; i++) {
+		size_t exact = 0, cover = 0;
+
+		// Count the tiles that the other set has as well, and the
+		// tiles where the other set draws at another zoom level:
+		FOREACH_NELEM (set[i].tile, set[i].used, t) {
+			exact += contains(&set[!i], t);
+			cover += covered(&set[!i], t);
+		}
+
+		printf("%-10s %8zu %10zu %10zu %12.3f\n", name[i], set[i].used, exact, cover, elapsed[i] * 1e3);
+	}
+}
+
+// Compare sampling densities against the densest sampling, by the fraction
+// of its tiles that are found:
+static void
+sweep (const int frames)
+{
+	static const float quality[] = { 0.5f, 1.0f, 2.0f, 4.0f };
+	static struct set ref, set;
+
+	tilepicker_set_quality(64.0f, true);
+	pick(TILEPICKER_GPU, 1, &ref);
+
+	printf("\n%-10s %8s %8s %10s %12s\n", "quality", "refine", "tiles", "recall", "ms/pick");
+
+	FOREACH (quality, q)
+		for (int refine = 0; refine < 2; refine++) {
+			size_t found = 0;
+
+			tilepicker_set_quality(*q, refine);
+			const double elapsed = pick(TILEPICKER_GPU, frames, &set);
+
+			FOREACH_NELEM (ref.tile, ref.used, t)
+				found += contains(&set, t);
+
+			printf("%-10.1f %8s %8zu %9.1f%% %12.3f\n", *q, refine ? "yes" : "no",
+				set.used, ref.used ? 100.0 * found / ref.used : 0.0, elapsed * 1e3);
+		}
+
+	tilepicker_set_quality(1.0f, false);
+}
+
+// Tiles to upload, and the textures that loader threads have uploaded but the
+// render thread has not yet adopted:
+#define UPLOAD_TILES	256
+#define UPLOAD_THREADS	4
+
+static struct {
+	struct cache_node    node[UPLOAD_TILES];
+	struct bitmap_cache  bitmap[UPLOAD_TILES];
+	struct texture_cache tex[UPLOAD_TILES];
+	size_t               done[UPLOAD_TILES];
+	size_t               ndone;
+	atomic_size_t        next;
+	pthread_mutex_t      lock;
+} load = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void
+load_init (void)
+{
+	for (size_t i = 0; i < UPLOAD_TILES; i++) {
+		uint32_t *pixels = malloc(256 * 256 * 4);
+
+		// Give every tile its own pattern:
+		for (size_t p = 0; p < 256 * 256; p++)
+			pixels[p] = (uint32_t) (i * 2654435761u + p);
+
+		load.node[i] = (struct cache_node) { .x = i % 16, .y = i / 16, .zoom = 8 };
+		load.bitmap[i] = (struct bitmap_cache) { .pixels = pixels };
+		globe_map_tile(&load.node[i], &load.bitmap[i].coords);
+	}
+}
+
+static void *
+loader (void *arg)
+{
+	size_t i;
+
+	(void) arg;
+
+	if (glshare_bind() == false)
+		return NULL;
+
+	while ((i = atomic_fetch_add(&load.next, 1)) < UPLOAD_TILES) {
+
+		// Wait for the render thread to adopt textures if the loader
+		// threads hold all their layers:
+		while (texture_cache_load(&load.bitmap[i], &load.tex[i]) == false)
+			usleep(100);
+
+		pthread_mutex_lock(&load.lock);
+		load.done[load.ndone++] = i;
+		pthread_mutex_unlock(&load.lock);
+	}
+
+	return NULL;
+}
+
+// Check a texture against its bitmap:
+static bool
+load_check (const size_t i)
+{
+	static uint32_t pixels[256 * 256];
+	struct cache_node out;
+	const struct texture_cache *tex;
+	GLint id;
+
+	if ((tex = texture_cache_search(&load.node[i], &out)) == NULL || out.zoom != load.node[i].zoom)
+		return false;
+
+	// Read back the layer from the RGBA array of the store:
+	texture_cache_bind();
+	glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &id);
+	glGetTextureSubImage(id, 0, 0, 0, tex->layer, 256, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE, sizeof (pixels), pixels);
+
+	return memcmp(pixels, load.bitmap[i].pixels, sizeof (pixels)) == 0;
+}
+
+// Draw frames until all tiles are uploaded, either by the render thread or by
+// loader threads. Returns the render thread time per frame, and the part of it
+// spent on uploads or on adopting uploaded textures:
+static double
+load_run (const struct texture_cache *tex, const bool threads, int *frames, double *upload, size_t *valid)
+{
+	pthread_t thread[UPLOAD_THREADS];
+	size_t uploaded = 0, done[UPLOAD_TILES], ndone;
+	double busy = 0.0;
+
+	// Start with an empty texture cache that fits all tiles:
+	texture_cache_destroy();
+	texture_cache_create(256 * 1024 * 1024);
+
+	if (threads)
+		texture_cache_reserve_loaders();
+
+	atomic_store(&load.next, 0);
+	load.ndone = 0;
+	*upload = 0.0;
+
+	if (threads)
+		for (int i = 0; i < UPLOAD_THREADS; i++)
+			pthread_create(&thread[i], NULL, loader, NULL);
+
+	for (*frames = 0; uploaded < UPLOAD_TILES; (*frames)++) {
+		const double start = now();
+
+		if (threads) {
+			pthread_mutex_lock(&load.lock);
+			memcpy(done, load.done, load.ndone * sizeof (*done));
+			ndone = load.ndone;
+			load.ndone = 0;
+			pthread_mutex_unlock(&load.lock);
+
+			FOREACH_NELEM (done, ndone, i)
+				texture_cache_adopt(&load.node[*i], &load.tex[*i]);
+
+			uploaded += ndone;
+		}
+		else
+			while (uploaded < UPLOAD_TILES && texture_cache_insert(&load.node[uploaded], &load.bitmap[uploaded]) != NULL)
+				uploaded++;
+
+		*upload += now() - start;
+
+		frame(tex);
+		glFinish();
+		busy += now() - start;
+
+		// Leave the loader threads time, like a frame clock would:
+		usleep(1000);
+	}
+
+	if (threads)
+		for (int i = 0; i < UPLOAD_THREADS; i++)
+			pthread_join(thread[i], NULL);
+
+	*valid = 0;
+	for (size_t i = 0; i < UPLOAD_TILES; i++)
+		*valid += load_check(i);
+
+	*upload /= *frames;
+	return busy / *frames;
+}
+
+static void
+uploads (const struct texture_cache *tex)
+{
+	static const char *name[2] = { "render", "loaders" };
+	double upload;
+	size_t valid;
+	int frames;
+
+	if (glshare_create(UPLOAD_THREADS) == false) {
+		printf("\nShared contexts not available, skipping upload comparison\n");
+		return;
+	}
+
+	load_init();
+	printf("\n%-10s %8s %8s %8s %12s %12s\n", "uploads", "tiles", "valid", "frames", "ms/frame", "upload ms");
+
+	for (int threads = 0; threads < 2; threads++) {
+		const double busy = load_run(tex, threads, &frames, &upload, &valid);
+
+		printf("%-10s %8d %8zu %8d %12.3f %12.3f\n", name[threads], UPLOAD_TILES, valid, frames, busy * 1e3, upload * 1e3);
+	}
+
+	glshare_destroy();
+}
+
+static double
+run (const struct texture_cache *tex, const bool instanced, const int frames, size_t *tiles)
+{
+	tiledrawer_set_instanced(instanced);
+
+	// Warm up:
+	frame(tex);
+	glFinish();
+
+	const double start = now();
+
+	for (int i = 0; i < frames; i++)
+		*tiles = frame(tex);
+
+	glFinish();
+	return (now() - start) / frames;
+}
+
+// Program binary cache, kept out of the user's cache directory:
+static char cachedir[] = "/tmp/drawbench-XXXXXX";
+
+static int
+remove_entry (const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	(void) st;
+	(void) flag;
+	(void) ftw;
+
+	return remove(path);
+}
+
+static void
+cache_remove (void)
+{
+	nftw(cachedir, remove_entry, 4, FTW_DEPTH | FTW_PHYS);
+}
+
+// Time the creation of all programs with an empty and with a filled binary
+// cache:
+static void
+startup (void)
+{
+	static const char *name[2] = { "cold", "warm" };
+
+	cache_remove();
+	printf("\n%-10s %12s\n", "programs", "ms/init");
+
+	for (int warm = 0; warm < 2; warm++) {
+		programs_destroy();
+
+		const double start = now();
+
+		if (programs_init() == false) {
+			printf("%-10s %12s\n", name[warm], "failed");
+			return;
+		}
+
+		printf("%-10s %12.3f\n", name[warm], (now() - start) * 1e3);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	int opt, frames = 200;
+	double distance = 0.5, tilt = 0.0;
+	uint32_t size = 64;
+	size_t tiles = 0;
+
+	while ((opt = getopt(argc, argv, "d:t:s:n:")) != -1) {
+		switch (opt) {
+		case 'd': distance = atof(optarg); break;
+		case 't': tilt     = atof(optarg); break;
+		case 's': size     = atoi(optarg); break;
+		case 'n': frames   = atoi(optarg); break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-d distance] [-t tilt] [-s size] [-n frames]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (mkdtemp(cachedir) == NULL || setenv("XDG_CACHE_HOME", cachedir, 1) != 0) {
+		fprintf(stderr, "Cannot create cache directory\n");
+		return 1;
+	}
+
+	if (context_create(size, size) == false) {
+		fprintf(stderr, "Cannot create offscreen GL context\n");
+		return 1;
+	}
+
+	if (viewport_init(size, size) == false || texture_cache_create(16 * 1024 * 1024) == false) {
+		fprintf(stderr, "Cannot initialize renderer\n");
+		return 1;
+	}
+
+	viewport_resize(size, size);
+	camera_set_distance(distance);
+	camera_set_tilt(tilt * M_PI / 180.0);
+
+	// Paint until the matrices and the visible tile set are updated:
+	while (viewport_paint())
+		continue;
+
+	// Draw every tile from the first layer of the store:
+	const struct texture_cache tex = { .layer = 0 };
+	const double single    = run(&tex, false, frames, &tiles);
+	const double instanced = run(&tex, true,  frames, &tiles);
+
+	printf("%-10s %8s %10s %12s %10s\n", "path", "tiles", "calls", "ms/frame", "us/tile");
+	printf("%-10s %8zu %10zu %12.3f %10.3f\n", "per-tile", tiles, tiles, single * 1e3, tiles ? single * 1e6 / tiles : 0.0);
+	printf("%-10s %8zu %10d %12.3f %10.3f\n", "instanced", tiles, 1, instanced * 1e3, tiles ? instanced * 1e6 / tiles : 0.0);
+
+	compare(frames);
+	sweep(frames);
+	uploads(&tex);
+	startup();
+
+	texture_cache_destroy();
+	tiledrawer_destroy();
+	viewport_destroy();
+	context_destroy();
+	cache_remove();
+	return 0;
+}
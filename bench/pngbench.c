@@ -0,0 +1,248 @@
+// Benchmark the PNG decoder backends against a corpus of tiles. Every file is
+// decoded by every backend, and the output is checked to be identical to that
+// of libpng. Runs single-threaded, so all figures are per core.
+//
+// Usage: pngbench [-i] [-r] [-n iterations] file.png...
+//
+// With -i, paletted images are decoded to indices plus a palette. With -r,
+// images are decoded to RGBA instead of RGB.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../png.h"
+#include "../util.h"
+
+// Image classes, by the PNG color type byte in the header:
+enum class {
+	CLASS_PALETTE,
+	CLASS_RGB,
+	CLASS_RGBA,
+	CLASS_OTHER,
+};
+
+static const char *class_name[] = {
+	[CLASS_PALETTE] = "palette",
+	[CLASS_RGB]     = "rgb",
+	[CLASS_RGBA]    = "rgba",
+	[CLASS_OTHER]   = "other",
+};
+
+static const struct {
+	const char      *name;
+	enum png_backend backend;
+} backends[] = {
+	{ "libpng",  PNG_BACKEND_LIBPNG  },
+	{ "inflate", PNG_BACKEND_INFLATE },
+	{ "auto",    PNG_BACKEND_AUTO    },
+};
+
+struct file {
+	const char    *name;
+	uint8_t       *buf;
+	size_t         len;
+	enum class     class;
+};
+
+// Whether to keep paletted images indexed:
+static bool indexed = false;
+
+// Whether to output RGBA:
+static bool rgba = false;
+
+struct result {
+	size_t tiles;
+	size_t bytes;
+	size_t failed;
+	size_t mismatch;
+	double secs;
+};
+
+static double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static enum class
+classify (const uint8_t *buf, const size_t len)
+{
+	// The color type is at a fixed offset in the IHDR chunk:
+	if (len < 26)
+		return CLASS_OTHER;
+
+	switch (buf[25]) {
+	case 2:  return CLASS_RGB;
+	case 3:  return CLASS_PALETTE;
+	case 6:  return CLASS_RGBA;
+	default: return CLASS_OTHER;
+	}
+}
+
+static bool
+file_read (struct file *f, const char *name)
+{
+	FILE *fp;
+	struct stat st;
+
+	if (stat(name, &st) || (fp = fopen(name, "rb")) == NULL)
+		return false;
+
+	f->name = name;
+	f->len  = st.st_size;
+
+	if ((f->buf = malloc(f->len)) == NULL || fread(f->buf, 1, f->len, fp) != f->len) {
+		free(f->buf);
+		fclose(fp);
+		return false;
+	}
+
+	fclose(fp);
+	f->class = classify(f->buf, f->len);
+	return true;
+}
+
+// Decode a file with the given backend, return false on failure.
+static bool
+decode (const struct file *f, const enum png_backend backend, struct png_out *out)
+{
+	const struct png_in in = {
+		.name    = f->name,
+		.buf     = f->buf,
+		.len     = f->len,
+		.backend = backend,
+		.indexed = indexed,
+		.rgba    = rgba,
+	};
+
+	return png_load(&in, out);
+}
+
+// Check the output of a backend against the reference output from libpng.
+static bool
+matches (const struct png_out *ref, const struct png_out *out)
+{
+	if (ref->width != out->width || ref->height != out->height || ref->channels != out->channels)
+		return false;
+
+	return memcmp(ref->buf, out->buf, png_out_size(ref)) == 0;
+}
+
+static void
+run (const struct file *files, const size_t nfiles, const size_t backend, const int iterations, struct result result[])
+{
+	FOREACH_NELEM (files, nfiles, f) {
+		struct result *r = &result[f->class];
+		struct png_out ref, out;
+		const bool have_ref = decode(f, PNG_BACKEND_LIBPNG, &ref);
+
+		// Check correctness once, outside of the timed loop:
+		if (decode(f, backends[backend].backend, &out) == false) {
+			r->failed++;
+			free(ref.buf);
+			continue;
+		}
+
+		if (have_ref == false || matches(&ref, &out) == false)
+			r->mismatch++;
+
+		free(ref.buf);
+		free(out.buf);
+
+		const double start = now();
+
+		for (int i = 0; i < iterations; i++) {
+			decode(f, backends[backend].backend, &out);
+			free(out.buf);
+		}
+
+		r->secs  += now() - start;
+		r->tiles += iterations;
+		r->bytes += (size_t) iterations * out.height * out.width * out.channels;
+	}
+}
+
+static void
+report (const size_t backend, const struct result result[])
+{
+	for (size_t c = 0; c < NELEM(class_name); c++) {
+		const struct result *r = &result[c];
+
+		if (r->tiles == 0 && r->failed == 0)
+			continue;
+
+		printf("%-8s %-8s %8zu %10.1f %10.1f %7zu %9zu\n",
+			backends[backend].name, class_name[c], r->tiles,
+			r->secs > 0.0 ? r->bytes / r->secs / 1e6 : 0.0,
+			r->secs > 0.0 ? r->tiles / r->secs : 0.0,
+			r->failed, r->mismatch);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	int opt, iterations = 10;
+	struct file *files;
+	size_t nfiles = 0;
+
+	while ((opt = getopt(argc, argv, "irn:")) != -1) {
+		switch (opt) {
+		case 'i':
+			indexed = true;
+			break;
+
+		case 'r':
+			rgba = true;
+			break;
+
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-i] [-r] [-n iterations] file.png...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind == argc || iterations <= 0) {
+		fprintf(stderr, "Usage: %s [-i] [-r] [-n iterations] file.png...\n", argv[0]);
+		return 1;
+	}
+
+	if ((files = calloc(argc - optind, sizeof (*files))) == NULL)
+		return 1;
+
+	// Load the whole corpus into memory first:
+	for (int i = optind; i < argc; i++)
+		if (file_read(&files[nfiles], argv[i]))
+			nfiles++;
+		else
+			fprintf(stderr, "%s: cannot read\n", argv[i]);
+
+	printf("%-8s %-8s %8s %10s %10s %7s %9s\n",
+		"backend", "class", "tiles", "MB/s", "tiles/s", "failed", "mismatch");
+
+	for (size_t b = 0; b < NELEM(backends); b++) {
+		struct result result[NELEM(class_name)] = { 0 };
+
+		run(files, nfiles, b, iterations, result);
+		report(b, result);
+	}
+
+	FOREACH_NELEM (files, nfiles, f)
+		free(f->buf);
+
+	free(files);
+	return 0;
+}
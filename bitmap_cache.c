@@ -1,10 +1,14 @@
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <pthread.h>
 
-#include "gui/framerate.h"
+#include "repaint.h"
 #include "bitmap_cache.h"
 #include "globe.h"
+#include "glshare.h"
+#include "texture_cache.h"
 #include "thread.h"
 #include "threadpool.h"
 #include "pngloader.h"
@@ -13,37 +17,140 @@
 #define THREADPOOL_JOBS		40
 #define THREADPOOL_THREADS	8
 
+// On a cold start, first load the ancestors this many levels up, each of which
+// covers the area of 4^n requested tiles:
+#define COARSE_LEVELS		3
+
 static struct cache      *cache = NULL;
 static struct threadpool *tpool = NULL;
 static pthread_mutex_t    mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static struct bitmap_cache_prefetch_stats stats;
+static struct bitmap_cache_stats search_stats;
+
+static int64_t
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
+// A decoded tile on its way from a worker thread to the render thread, and
+// its texture if the worker uploaded it:
+struct completion {
+	struct completion    *next;
+	struct cache_node     loc;
+	struct bitmap_cache   bitmap;
+	struct texture_cache  tex;
+	bool                  uploaded;
+};
+
+// Whether worker threads upload their tiles through shared contexts:
+static atomic_bool upload = false;
+
+// Lock-free stack of completed tiles. Workers push tiles one at a time, the
+// render thread takes all of them at once:
+static _Atomic (struct completion *) completed = NULL;
+
 void
-bitmap_cache_insert (const struct cache_node *loc, void *rgb)
+bitmap_cache_insert (const struct cache_node *loc, const struct png_out *png)
 {
-	struct bitmap_cache bitmap = { .rgb = rgb };
+	struct completion *c;
+
+	if ((c = malloc(sizeof (*c))) == NULL) {
+		pngloader_free(png->buf);
+		return;
+	}
+
+	c->loc    = *loc;
+	c->bitmap = (struct bitmap_cache) {
+		.pixels  = png->buf,
+		.palette = (const uint8_t (*)[3]) png->palette,
+	};
 
 	// Calculate 3D sphere xyz coordinates for this tile:
-	globe_map_tile(loc, &bitmap.coords);
+	globe_map_tile(loc, &c->bitmap.coords);
 
-	// Insert the cache data structure into the bitmap cache:
-	if (thread_mutex_lock(&mutex)) {
-		cache_insert(cache, loc, &bitmap);
-		thread_mutex_unlock(&mutex);
-	}
+	// Upload the texture from this thread if enabled. If this thread has
+	// no context or no layer is free, the render thread uploads it:
+	c->uploaded = atomic_load(&upload)
+		&& glshare_bind()
+		&& texture_cache_load(&c->bitmap, &c->tex);
+
+	c->next = atomic_load_explicit(&completed, memory_order_relaxed);
+
+	// Push the tile onto the stack. The release order publishes the tile
+	// data to the render thread:
+	while (!atomic_compare_exchange_weak_explicit(&completed, &c->next, c,
+			memory_order_release, memory_order_relaxed))
+		continue;
 
 	// Ask for a redraw of the viewport:
 	framerate_repaint();
 }
 
+// Move a completed tile into the caches. Keep the prefetch flag of the
+// placeholder. Returns true if a texture was adopted:
+static bool
+complete (struct completion *c)
+{
+	struct cache_node out;
+	const struct bitmap_cache *old;
+
+	// Time the load from the request that inserted the placeholder:
+	if ((old = cache_search(cache, &c->loc, &out)) != NULL && out.zoom == c->loc.zoom) {
+		c->bitmap.prefetched = old->prefetched;
+
+		if (old->pixels == NULL && old->requested > 0) {
+			const double latency = (now() - old->requested) / 1e9;
+
+			search_stats.loads++;
+			search_stats.latency += latency;
+
+			if (latency > search_stats.latency_max)
+				search_stats.latency_max = latency;
+		}
+	}
+
+	cache_insert(cache, &c->loc, &c->bitmap);
+
+	return c->uploaded && texture_cache_adopt(&c->loc, &c->tex) != NULL;
+}
+
+bool
+bitmap_cache_drain (void)
+{
+	struct completion *c, *next, *list = NULL;
+	bool adopted = false;
+
+	// Take all completed tiles, and reverse the stack to insert them in
+	// order of completion:
+	for (c = atomic_exchange_explicit(&completed, NULL, memory_order_acquire); c; c = next) {
+		next    = c->next;
+		c->next = list;
+		list    = c;
+	}
+
+	for (c = list; c; c = next) {
+		next     = c->next;
+		adopted |= complete(c);
+		free(c);
+	}
+
+	return adopted;
+}
+
 static void
 process (void *data)
 {
-	void *rgb;
+	struct png_out png;
 	struct cache_node *req = data;
 
 	// Store rawbits data pointer into cache data structure if found:
-	if ((rgb = pngloader_main(req)) != NULL)
-		bitmap_cache_insert(req, rgb);
+	if (pngloader_main(req, &png))
+		bitmap_cache_insert(req, &png);
 }
 
 static void
@@ -51,29 +158,107 @@ on_destroy (void *data)
 {
 	struct bitmap_cache *bitmap = data;
 
-	free(bitmap->rgb);
+	pngloader_free(bitmap->pixels);
 }
 
+static bool
+job_match (const void *job, const void *arg)
+{
+	const struct cache_node *a = job, *b = arg;
+
+	return a->x == b->x && a->y == b->y && a->zoom == b->zoom;
+}
+
+// Count the outcome of a prefetch when the tile is first requested. If it is
+// still loading, move it up to regular priority:
 static void
+prefetch_resolve (struct bitmap_cache *data, const struct cache_node *loc)
+{
+	data->prefetched = false;
+
+	if (data->pixels != NULL) {
+		stats.hits++;
+		return;
+	}
+
+	stats.late++;
+
+	if (threadpool_job_cancel(tpool, job_match, loc) > 0)
+		threadpool_job_enqueue(tpool, (void *) loc);
+}
+
+// Load coarse tiles before fine tiles:
+static bool
+job_before (const void *a, const void *b)
+{
+	const struct cache_node *na = a, *nb = b;
+
+	return na->zoom < nb->zoom;
+}
+
+// A queued job was replaced by a coarser one or cancelled. Flag its
+// placeholder, so that a later search procures the tile again. The caller
+// holds the lock:
+static void
+job_drop (void *job)
+{
+	struct cache_node out;
+	struct bitmap_cache *data;
+	const struct cache_node *loc = job;
+
+	if ((data = cache_search(cache, loc, &out)) != NULL && out.zoom == loc->zoom)
+		data->cancelled = true;
+}
+
+static bool
 procure (const struct cache_node *loc)
 {
 	// Enqueue a job in the threadpool:
 	if (threadpool_job_enqueue(tpool, (void *) loc) == false)
-		return;
+		return false;
 
 	// Insert a placeholder node into the cache to tell the system that
 	// there is already a lookup in progress for this node. The node will
 	// be overwritten by the thread when it is done. Until then, it acts as
 	// a "tombstone", preventing multiple requeues of the same job:
-	cache_insert(cache, loc, &(struct bitmap_cache) { .rgb = NULL });
+	cache_insert(cache, loc, &(struct bitmap_cache) { .pixels = NULL, .requested = now() });
+	return true;
+}
+
+// Load the tiles on the path from the best available bitmap to the requested
+// tile coarse to fine. Start a few levels above the requested tile, so that a
+// handful of coarse tiles covers the view quickly, then refine one level at a
+// time. The procuring mask has a bit set for every level that is loading:
+static void
+schedule (const struct cache_node *in, const uint32_t have, const uint32_t procuring)
+{
+	const uint32_t coarse = in->zoom > COARSE_LEVELS ? in->zoom - COARSE_LEVELS : 0;
+	struct cache_node level = *in;
+	uint32_t zoom = have > coarse ? have : coarse;
+
+	// Skip the levels that are already loading, so that the next level
+	// can be queued while the coarser one is in flight:
+	while (zoom <= in->zoom && (procuring >> zoom) & 1)
+		zoom++;
+
+	if (zoom > in->zoom)
+		return;
+
+	while (level.zoom > zoom)
+		cache_node_up(&level);
+
+	// Queue one level per search. If there are finer levels left to queue,
+	// ask for another frame to queue the next one:
+	if (procure(&level) && zoom < in->zoom)
+		framerate_repaint();
 }
 
 const struct bitmap_cache *
 bitmap_cache_search (const struct cache_node *in, struct cache_node *out)
 {
-	bool procuring = false;
+	uint32_t procuring = 0;
 	struct cache_node level = *in;
-	const struct bitmap_cache *data;
+	struct bitmap_cache *data;
 
 	while (true) {
 
@@ -82,31 +267,115 @@ bitmap_cache_search (const struct cache_node *in, struct cache_node *out)
 		if ((data = cache_search(cache, &level, out)) == NULL)
 			break;
 
+		if (data->prefetched && in->zoom == out->zoom)
+			prefetch_resolve(data, in);
+
 		// If we got back non-NULL pixels, it is a valid bitmap:
-		if (data->rgb != NULL)
+		if (data->pixels != NULL)
 			break;
 
 		// We got back a valid data pointer but with NULL pixels. This
 		// indicates that the tile we landed on is currently being
-		// procured. Check if the procurement is for the tile we want:
-		if (in->zoom == out->zoom)
-			procuring = true;
+		// procured, unless the procurement has been cancelled:
+		if (data->cancelled == false)
+			procuring |= 1u << out->zoom;
 
-		// Move up one zoom layer and retry:
+		// Move up one zoom layer from the placeholder and retry:
+		level = *out;
 		if (cache_node_up(&level) == false) {
 			data = NULL;
 			break;
 		}
 	}
 
-	// If no node was found or it is at a different zoom level than
-	// requested, then start a threadpool job to procure the target:
-	if (procuring == false && (data == NULL || in->zoom != out->zoom))
-		procure(in);
+	search_stats.searches++;
+
+	if (data != NULL && out->zoom == in->zoom)
+		search_stats.hits++;
+
+	// Start loading the next levels between the found bitmap, if any, and
+	// the requested tile:
+	schedule(in, data ? out->zoom + 1 : 0, procuring);
+
+	// Keep the bitmap alive after the cache is unlocked:
+	if (data != NULL)
+		cache_ref(cache, data);
 
 	return data;
 }
 
+void
+bitmap_cache_release (const struct bitmap_cache *bitmap)
+{
+	cache_unref(cache, bitmap);
+}
+
+void
+bitmap_cache_cancel (const struct cache_node *loc)
+{
+	// If the job was still queued, flag its placeholder, so that a later
+	// search procures the tile again:
+	if (threadpool_job_cancel(tpool, job_match, loc) > 0)
+		job_drop((void *) loc);
+
+	cache_expire(cache, loc);
+}
+
+bool
+bitmap_cache_idle (void)
+{
+	// A worker pushes its tile before it counts as finished, so check the
+	// threadpool first:
+	return threadpool_idle(tpool)
+	    && atomic_load_explicit(&completed, memory_order_acquire) == NULL;
+}
+
+bool
+bitmap_cache_set_upload (const bool enable)
+{
+	// Shared contexts are created from the current context once. The
+	// texture cache gives up layers for the loaders only when they upload:
+	if (enable)
+		if (glshare_create(THREADPOOL_THREADS) == false || texture_cache_reserve_loaders() == false)
+			return false;
+
+	atomic_store(&upload, enable);
+	return true;
+}
+
+bool
+bitmap_cache_prefetch (const struct cache_node *loc)
+{
+	struct cache_node out;
+
+	if (cache == NULL)
+		return false;
+
+	// Nothing to do if the tile is cached or being procured:
+	if (cache_search(cache, loc, &out) != NULL && out.zoom == loc->zoom)
+		return false;
+
+	if (threadpool_job_enqueue_low(tpool, (void *) loc) == false)
+		return false;
+
+	// Insert a placeholder, like procure() does:
+	cache_insert(cache, loc, &(struct bitmap_cache) { .pixels = NULL, .prefetched = true, .requested = now() });
+	stats.issued++;
+	return true;
+}
+
+void
+bitmap_cache_prefetch_stats (struct bitmap_cache_prefetch_stats *s)
+{
+	*s = stats;
+}
+
+void
+bitmap_cache_stats (struct bitmap_cache_stats *s)
+{
+	*s = search_stats;
+}
+
 void
 bitmap_cache_lock (void)
 {
@@ -123,7 +392,13 @@ void
 bitmap_cache_destroy (void)
 {
 	threadpool_destroy(tpool);
+
+	// Insert the tiles that completed since the last drain, so that the
+	// caches release them:
+	bitmap_cache_drain();
 	cache_destroy(cache);
+	glshare_destroy();
+	pngloader_destroy();
 }
 
 bool
@@ -137,6 +412,8 @@ bitmap_cache_create (void)
 
 	const struct threadpool_config threadpool_config = {
 		.process = process,
+		.before  = job_before,
+		.drop    = job_drop,
 		.jobsize = sizeof (struct cache_node),
 		.num = {
 			.jobs    = THREADPOOL_JOBS,
@@ -144,11 +421,20 @@ bitmap_cache_create (void)
 		},
 	};
 
-	if ((cache = cache_create(&cache_config)) == NULL)
+	// Every cached bitmap occupies one slot, every worker thread can hold
+	// one more slot while it decodes a tile, and every queued job one more
+	// until its tile is drained into the cache:
+	if (pngloader_create(CACHE_SIZE + THREADPOOL_THREADS + THREADPOOL_JOBS) == false)
 		return false;
 
+	if ((cache = cache_create(&cache_config)) == NULL) {
+		pngloader_destroy();
+		return false;
+	}
+
 	if ((tpool = threadpool_create(&threadpool_config)) == NULL) {
 		cache_destroy(cache);
+		pngloader_destroy();
 		return false;
 	}
 
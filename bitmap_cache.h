@@ -1,24 +1,92 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "cache.h"
 #include "globe.h"
+#include "png.h"
 
 // Data structure stored in and retrieved from the bitmap cache.
 struct bitmap_cache {
 	struct globe_tile coords;
-	void             *rgb;
+
+	// RGBA pixels, or one palette index per pixel for indexed tiles.
+	void *pixels;
+
+	// Palette for indexed tiles, NULL for RGBA tiles.
+	const uint8_t (*palette)[3];
+
+	// Set on the placeholder of a tile whose load was cancelled.
+	bool cancelled;
+
+	// Set on a tile that was prefetched, until it is first requested.
+	bool prefetched;
+
+	// Time of the request in nsec, on the placeholder of a loading tile.
+	int64_t requested;
+};
+
+// Outcome of prefetches: the number of tiles prefetched, and of those that
+// were later requested, the number that had been loaded in time or not.
+struct bitmap_cache_prefetch_stats {
+	size_t issued;
+	size_t hits;
+	size_t late;
 };
 
-// Insert an entry into to the bitmap cache.
-extern void bitmap_cache_insert (const struct cache_node *loc, void *rgb);
+// Outcome of searches: the number of searches, and of those the number that
+// found the requested tile. Also the number of tiles that arrived in the cache,
+// and the total and the maximal time from their request to their arrival.
+struct bitmap_cache_stats {
+	size_t searches;
+	size_t hits;
+	size_t loads;
+	double latency;
+	double latency_max;
+};
+
+// Hand a decoded tile to the render thread. This function does not lock and
+// can be called from any thread. The tile enters the cache at the next drain.
+extern void bitmap_cache_insert (const struct cache_node *loc, const struct png_out *png);
+
+// Insert the tiles that were decoded since the last call into the cache. The
+// render thread calls this once per frame, with the cache locked. Returns true
+// if textures uploaded by the loader threads entered the texture cache, which
+// can evict textures found before.
+extern bool bitmap_cache_drain (void);
 
 // Request data from the bitmap cache. Before calling this function, the user
-// must lock the cache. The cache must be unlocked only after the returned data
-// has been used, or there is a risk of race conditions with the threadpool.
+// must lock the cache. The returned data holds a reference, so it stays valid
+// after the cache is unlocked, until it is released.
 extern const struct bitmap_cache *bitmap_cache_search (const struct cache_node *in, struct cache_node *out);
 
+// Release data returned by a search. This does not need the lock.
+extern void bitmap_cache_release (const struct bitmap_cache *bitmap);
+
+// Give up on a tile that is no longer visible. A load that has not started yet
+// is cancelled, and the tile becomes the first candidate for eviction. The
+// user must lock the cache before calling this function.
+extern void bitmap_cache_cancel (const struct cache_node *loc);
+
+// Start loading a tile that is expected to become visible soon, at a lower
+// priority than the tiles that are visible now. Returns false if the tile is
+// already cached or could not be queued. The user must lock the cache before
+// calling this function.
+extern bool bitmap_cache_prefetch (const struct cache_node *loc);
+extern void bitmap_cache_prefetch_stats (struct bitmap_cache_prefetch_stats *stats);
+extern void bitmap_cache_stats (struct bitmap_cache_stats *stats);
+
+// Returns true if no tiles are loading and all loaded tiles are drained into
+// the cache.
+extern bool bitmap_cache_idle (void);
+
+// Let the worker threads upload their tiles to the texture cache through GL
+// contexts shared with the context that is current on the calling thread.
+// Returns false if shared contexts are not available, in which case the
+// render thread keeps uploading the tiles.
+extern bool bitmap_cache_set_upload (const bool enable);
+
 extern void bitmap_cache_lock   (void);
 extern void bitmap_cache_unlock (void);
 
@@ -1,3 +1,4 @@
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -39,6 +40,18 @@ struct cache {
 	// Number of entries in use.
 	uint32_t used;
 
+	// Reference counts of the entries.
+	atomic_uint *refs;
+
+	// Entries that were replaced while referenced. They are destroyed once
+	// the last reference is released.
+	uint32_t *retired;
+	uint32_t  nretired;
+
+	// Entries below #used that have become vacant.
+	uint32_t *vacant;
+	uint32_t  nvacant;
+
 	// Total number of entries available.
 	uint32_t capacity;
 
@@ -141,10 +154,18 @@ destroy (struct cache *c, struct level *l, struct node *n)
 	return index;
 }
 
-// Remove the node accessed longest ago across all zoom layers, return the
-// index in the entry array which has been made available.
-static uint32_t
-purge_stalest (struct cache *c)
+// Check whether an entry is referenced.
+static inline bool
+referenced (struct cache *c, const uint32_t index)
+{
+	return atomic_load_explicit(&c->refs[index], memory_order_acquire) > 0;
+}
+
+// Remove the unreferenced node accessed longest ago across all zoom layers,
+// store the index in the entry array which has been made available. Returns
+// false if all nodes are referenced.
+static bool
+purge_stalest (struct cache *c, uint32_t *index)
 {
 	struct {
 		struct node  *n;
@@ -153,12 +174,54 @@ purge_stalest (struct cache *c)
 
 	FOREACH (c->level, level)
 		FOREACH_NELEM (level->node, level->used, node)
-			if (victim.n == NULL || node->atime < victim.n->atime) {
-				victim.n = node;
-				victim.l = level;
-			}
+			if (victim.n == NULL || node->atime < victim.n->atime)
+				if (referenced(c, node->index) == false) {
+					victim.n = node;
+					victim.l = level;
+				}
 
-	return victim.n == NULL ? 0 : destroy(c, victim.l, victim.n);
+	if (victim.n == NULL)
+		return false;
+
+	*index = destroy(c, victim.l, victim.n);
+	return true;
+}
+
+// Destroy the retired entries that are no longer referenced.
+static void
+reclaim (struct cache *c)
+{
+	for (uint32_t i = 0; i < c->nretired; ) {
+		const uint32_t index = c->retired[i];
+
+		if (referenced(c, index)) {
+			i++;
+			continue;
+		}
+
+		c->destroy(entry_ptr(c, index));
+		c->vacant[c->nvacant++] = index;
+		c->retired[i] = c->retired[--c->nretired];
+	}
+}
+
+// Get a free entry, purging the stalest node if needed.
+static bool
+entry_alloc (struct cache *c, uint32_t *index)
+{
+	reclaim(c);
+
+	if (c->nvacant > 0) {
+		*index = c->vacant[--c->nvacant];
+		return true;
+	}
+
+	if (c->used < c->capacity) {
+		*index = c->used++;
+		return true;
+	}
+
+	return purge_stalest(c, index);
 }
 
 // Search for a matching node at given zoom level or lower.
@@ -174,25 +237,39 @@ cache_search (struct cache *c, const struct cache_node *in, struct cache_node *o
 	return entry_ptr(c, node->index);
 }
 
-// Replace the data in an existing node.
-static const struct node *
-replace (struct cache *c, const struct cache_node *loc, void *data)
+// Mark a node as accessed longest ago, so that it is purged first.
+bool
+cache_expire (struct cache *c, const struct cache_node *loc)
 {
-	struct node *n;
+	struct node *node;
 
-	if ((n = search_level(c, loc)) == NULL)
-		return NULL;
+	if ((node = search_level(c, loc)) == NULL)
+		return false;
+
+	node->atime = 0;
+	return true;
+}
 
-	c->destroy(entry_ptr(c, n->index));
-	memcpy(entry_ptr(c, n->index), data, c->entrysize);
+void
+cache_ref (struct cache *c, const void *data)
+{
+	const uint32_t index = ((const uint8_t *) data - c->entry) / c->entrysize;
 
-	n->atime = ++c->counter;
-	return n;
+	atomic_fetch_add_explicit(&c->refs[index], 1, memory_order_relaxed);
+}
+
+void
+cache_unref (struct cache *c, const void *data)
+{
+	const uint32_t index = ((const uint8_t *) data - c->entry) / c->entrysize;
+
+	atomic_fetch_sub_explicit(&c->refs[index], 1, memory_order_release);
 }
 
 void *
 cache_insert (struct cache *c, const struct cache_node *loc, void *data)
 {
+	struct node *n;
 	uint32_t index;
 
 	// Run basic sanity checks on the given location:
@@ -201,22 +278,37 @@ cache_insert (struct cache *c, const struct cache_node *loc, void *data)
 		return NULL;
 	}
 
-	// If a node already exists at the location, reuse it:
-	const struct node *reused;
-	if ((reused = replace(c, loc, data)) != NULL)
-		return entry_ptr(c, reused->index);
+	// If a node already exists at the location and its entry is not in
+	// use, replace the data in place:
+	if ((n = search_level(c, loc)) != NULL && referenced(c, n->index) == false) {
+		c->destroy(entry_ptr(c, n->index));
+		memcpy(entry_ptr(c, n->index), data, c->entrysize);
 
-	// If the list is at capacity, evict the oldest accessed node:
-	index = c->used == c->capacity ? purge_stalest(c) : c->used++;
+		n->atime = ++c->counter;
+		return entry_ptr(c, n->index);
+	}
 
-	// Insert this node last:
-	struct level *l = &c->level[loc->zoom];
-	struct node  *n = &l->node[l->used++];
+	// Get an entry for the data, evicting the oldest accessed node if the
+	// cache is at capacity:
+	if (entry_alloc(c, &index) == false) {
+		c->destroy(data);
+		return NULL;
+	}
+
+	// Purging can move nodes around, so search again. If the node exists,
+	// its entry is in use, so retire it. Otherwise insert this node last:
+	if ((n = search_level(c, loc)) != NULL)
+		c->retired[c->nretired++] = n->index;
+	else {
+		struct level *l = &c->level[loc->zoom];
+
+		n = &l->node[l->used++];
+		n->key = loc->key;
+	}
 
 	// Insert the data into the entry array:
 	memcpy(entry_ptr(c, index), data, c->entrysize);
 
-	n->key   = loc->key;
 	n->atime = ++c->counter;
 	n->index = index;
 	return entry_ptr(c, n->index);
@@ -228,12 +320,19 @@ cache_destroy (struct cache *c)
 	if (c == NULL)
 		return;
 
-	FOREACH (c->level, level)
+	FOREACH (c->level, level) {
+		FOREACH_NELEM (level->node, level->used, node)
+			c->destroy(entry_ptr(c, node->index));
+
 		free(level->node);
+	}
 
-	for (size_t i = 0; i < c->used; i++)
-		c->destroy(entry_ptr(c, i));
+	FOREACH_NELEM (c->retired, c->nretired, index)
+		c->destroy(entry_ptr(c, *index));
 
+	free(c->vacant);
+	free(c->retired);
+	free(c->refs);
 	free(c->entry);
 	free(c);
 }
@@ -257,6 +356,14 @@ cache_create (const struct cache_config *config)
 		return NULL;
 	}
 
+	// Allocate the reference counts and the lists of free entries:
+	if ((c->refs = calloc(config->capacity, sizeof (*c->refs))) == NULL
+	 || (c->retired = malloc(config->capacity * sizeof (*c->retired))) == NULL
+	 || (c->vacant  = malloc(config->capacity * sizeof (*c->vacant)))  == NULL) {
+		cache_destroy(c);
+		return NULL;
+	}
+
 	// Allocate memory for all node arrays:
 	for (size_t z = 0; z < NELEM(c->level); z++) {
 		struct level *level = &c->level[z];
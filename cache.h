@@ -43,13 +43,28 @@ static inline bool cache_node_up (struct cache_node *n)
 
 // Insert opaque data into the cache at a given level. If a node exists for the
 // location, it is reused. If the insertion would exceed the cache capacity,
-// the least active cache node is purged first to make space for the insertion.
+// the least active unreferenced cache node is purged first to make space for
+// the insertion. Returns NULL if every node is referenced, or if the location
+// is invalid. In that case the data is passed to the destroy callback, so that
+// the caller need not release it.
 extern void *cache_insert (struct cache *cache, const struct cache_node *loc, void *data);
 
 // Retrieve data from the cache at a given level. The function returns data at
 // this zoom level or lower. The #out member describes the returned node.
 extern void *cache_search (struct cache *cache, const struct cache_node *in, struct cache_node *out);
 
+// Take a reference to data returned by the cache. Referenced data is not
+// purged, and if its node is given new data, the old data is destroyed only
+// after the last reference is released. Needs the same locking as a search.
+extern void cache_ref (struct cache *cache, const void *data);
+
+// Release a reference. This does not need a lock.
+extern void cache_unref (struct cache *cache, const void *data);
+
+// Mark the node at exactly the given location as the first to be purged.
+// Returns false if there is no such node.
+extern bool cache_expire (struct cache *cache, const struct cache_node *loc);
+
 // Cache creation/destruction.
 extern void cache_destroy (struct cache *cache);
 extern struct cache *cache_create (const struct cache_config *config);
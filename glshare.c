@@ -0,0 +1,147 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+
+#include "glshare.h"
+#include "util.h"
+
+static struct {
+	EGLDisplay  display;
+	EGLContext *context;
+	size_t      num;
+	atomic_size_t next;
+} share;
+
+// The shared context bound to this thread, if any:
+static _Thread_local EGLContext bound = EGL_NO_CONTEXT;
+
+// Check for an extension in a space-separated list:
+static bool
+has_extension (const char *list, const char *name)
+{
+	const size_t len = strlen(name);
+
+	for (const char *p = list; p && (p = strstr(p, name)) != NULL; p += len)
+		if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+			return true;
+
+	return false;
+}
+
+// Find the config of the current context. Contexts without a config need the
+// no-config extension, and then the shared contexts go without one too:
+static bool
+config_find (EGLContext current, EGLConfig *config)
+{
+	EGLint id, n;
+
+	if (eglQueryContext(share.display, current, EGL_CONFIG_ID, &id) == EGL_FALSE)
+		return false;
+
+	if (id == 0) {
+		*config = EGL_NO_CONFIG_KHR;
+		return true;
+	}
+
+	const EGLint attr[] = {
+		EGL_CONFIG_ID, id,
+		EGL_NONE,
+	};
+
+	return eglChooseConfig(share.display, attr, config, 1, &n) == EGL_TRUE && n == 1;
+}
+
+bool
+glshare_create (const size_t num)
+{
+	EGLContext current;
+	EGLConfig config;
+	GLint major, minor, profile;
+
+	if (share.context != NULL)
+		return true;
+
+	// The current context must be an EGL context:
+	if ((current = eglGetCurrentContext()) == EGL_NO_CONTEXT)
+		return false;
+
+	share.display = eglGetCurrentDisplay();
+
+	// Loader threads have no surface to draw to:
+	if (has_extension(eglQueryString(share.display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context") == false)
+		return false;
+
+	if (config_find(current, &config) == false)
+		return false;
+
+	// Match the version and the profile of the current context:
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+
+	const EGLint attr[] = {
+		EGL_CONTEXT_MAJOR_VERSION,       major,
+		EGL_CONTEXT_MINOR_VERSION,       minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, profile & GL_CONTEXT_CORE_PROFILE_BIT
+			? EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT
+			: EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE,
+	};
+
+	if ((share.context = calloc(num, sizeof (*share.context))) == NULL)
+		return false;
+
+	for (share.num = 0; share.num < num; share.num++)
+		if ((share.context[share.num] = eglCreateContext(share.display, config, current, attr)) == EGL_NO_CONTEXT) {
+			glshare_destroy();
+			return false;
+		}
+
+	atomic_store(&share.next, 0);
+	return true;
+}
+
+bool
+glshare_bind (void)
+{
+	size_t n;
+
+	if (bound != EGL_NO_CONTEXT)
+		return true;
+
+	if (share.context == NULL)
+		return false;
+
+	// Take the next unused context:
+	if ((n = atomic_fetch_add(&share.next, 1)) >= share.num)
+		return false;
+
+	if (eglMakeCurrent(share.display, EGL_NO_SURFACE, EGL_NO_SURFACE, share.context[n]) == EGL_FALSE)
+		return false;
+
+	bound = share.context[n];
+	return true;
+}
+
+bool
+glshare_available (void)
+{
+	return share.context != NULL;
+}
+
+// Call only after the threads that use the contexts have exited. Contexts
+// that are still bound are deleted by EGL when their thread releases them:
+void
+glshare_destroy (void)
+{
+	FOREACH_NELEM (share.context, share.num, context)
+		eglDestroyContext(share.display, *context);
+
+	free(share.context);
+	share.context = NULL;
+	share.num     = 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Create a number of GL contexts that share their objects with the context
+// that is current on the calling thread. Only EGL contexts can be shared, and
+// the implementation must support contexts without a surface. Returns false
+// if that is not the case.
+extern bool glshare_create (const size_t num);
+
+// Make one of the shared contexts current on the calling thread. The context
+// stays bound to the thread from then on. Returns false if all contexts are
+// taken by other threads.
+extern bool glshare_bind (void);
+
+// Check whether shared contexts have been created.
+extern bool glshare_available (void);
+
+extern void glshare_destroy (void);
@@ -1,8 +1,45 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "glutil.h"
 #include "png.h"
 
+// Texture units and targets whose bindings are cached:
+#define TEXTURE_UNITS	8
+
+enum	{ TARGET_2D
+	, TARGET_2D_ARRAY
+	, TARGET_COUNT
+	} ;
+
+// Bits in the mask of known state:
+enum	{ KNOWN_PROGRAM      = 1 << 0
+	, KNOWN_VERTEX_ARRAY = 1 << 1
+	, KNOWN_ACTIVE       = 1 << 2
+	, KNOWN_BLEND        = 1 << 3
+	, KNOWN_DEPTH_TEST   = 1 << 4
+	, KNOWN_DEPTH_MASK   = 1 << 5
+	, KNOWN_VIEWPORT     = 1 << 6
+	, KNOWN_TEXTURE      = 1 << 7
+	} ;
+
+#define KNOWN_TEXTURE_BIT(UNIT, TARGET)	(KNOWN_TEXTURE << ((UNIT) * TARGET_COUNT + (TARGET)))
+
+// Cached state. Only the values with their bit set in the mask are known:
+static struct {
+	uint32_t known;
+	GLuint   program;
+	GLuint   vertex_array;
+	GLuint   active;
+	GLuint   texture[TEXTURE_UNITS][TARGET_COUNT];
+	GLuint   blend;
+	GLuint   depth_test;
+	GLuint   depth_mask;
+	GLint    viewport[4];
+	uint32_t elided;
+	uint32_t elided_frame;
+} state;
+
 // Array of indices. If we have a quad defined by these corners:
 //
 //   3--2
@@ -67,7 +104,7 @@ glutil_texture_load (struct glutil_texture *tex)
 
 	// Generate texture:
 	glGenTextures(1, &tex->id);
-	glBindTexture(GL_TEXTURE_2D, tex->id);
+	glutil_texture(0, GL_TEXTURE_2D, tex->id);
 
 	// Default texture settings:
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -90,3 +127,128 @@ glutil_texture_load (struct glutil_texture *tex)
 
 	return true;
 }
+
+// Check whether a value is already set. If not, record it as the new value:
+static bool
+cached (const uint32_t bit, GLuint *value, const GLuint want)
+{
+	if ((state.known & bit) && *value == want) {
+		state.elided++;
+		return true;
+	}
+
+	state.known |= bit;
+	*value = want;
+	return false;
+}
+
+static void
+capability (const uint32_t bit, GLuint *value, const GLenum cap, const bool enable)
+{
+	if (cached(bit, value, enable))
+		return;
+
+	if (enable)
+		glEnable(cap);
+	else
+		glDisable(cap);
+}
+
+void
+glutil_program (const GLuint id)
+{
+	if (!cached(KNOWN_PROGRAM, &state.program, id))
+		glUseProgram(id);
+}
+
+void
+glutil_vertex_array (const GLuint id)
+{
+	if (!cached(KNOWN_VERTEX_ARRAY, &state.vertex_array, id))
+		glBindVertexArray(id);
+}
+
+void
+glutil_texture (const GLuint unit, const GLenum target, const GLuint id)
+{
+	const int t = target == GL_TEXTURE_2D       ? TARGET_2D
+		    : target == GL_TEXTURE_2D_ARRAY ? TARGET_2D_ARRAY
+		    : -1;
+
+	// Texture updates apply to the active unit, so always select it:
+	if (!cached(KNOWN_ACTIVE, &state.active, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+
+	// Bindings outside the cache are always passed through:
+	if (t >= 0 && unit < TEXTURE_UNITS)
+		if (cached(KNOWN_TEXTURE_BIT(unit, t), &state.texture[unit][t], id))
+			return;
+
+	glBindTexture(target, id);
+}
+
+void
+glutil_blend (const bool enable)
+{
+	capability(KNOWN_BLEND, &state.blend, GL_BLEND, enable);
+}
+
+void
+glutil_depth_test (const bool enable)
+{
+	capability(KNOWN_DEPTH_TEST, &state.depth_test, GL_DEPTH_TEST, enable);
+}
+
+void
+glutil_depth_mask (const bool enable)
+{
+	if (!cached(KNOWN_DEPTH_MASK, &state.depth_mask, enable))
+		glDepthMask(enable ? GL_TRUE : GL_FALSE);
+}
+
+void
+glutil_viewport (const GLint x, const GLint y, const GLsizei width, const GLsizei height)
+{
+	const GLint want[4] = { x, y, width, height };
+
+	if ((state.known & KNOWN_VIEWPORT) && memcmp(state.viewport, want, sizeof (want)) == 0) {
+		state.elided++;
+		return;
+	}
+
+	state.known |= KNOWN_VIEWPORT;
+	memcpy(state.viewport, want, sizeof (want));
+	glViewport(x, y, width, height);
+}
+
+void
+glutil_viewport_get (GLint viewport[4])
+{
+	// Query the driver only if the viewport is not known:
+	if ((state.known & KNOWN_VIEWPORT) == 0) {
+		glGetIntegerv(GL_VIEWPORT, state.viewport);
+		state.known |= KNOWN_VIEWPORT;
+	}
+
+	memcpy(viewport, state.viewport, sizeof (state.viewport));
+}
+
+void
+glutil_state_reset (void)
+{
+	state.known = 0;
+}
+
+void
+glutil_state_frame (void)
+{
+	state.elided_frame = state.elided;
+	state.elided = 0;
+	glutil_state_reset();
+}
+
+uint32_t
+glutil_state_elided (void)
+{
+	return state.elided_frame;
+}
@@ -52,3 +52,24 @@ extern bool glutil_texture_load (struct glutil_texture *);
 
 // Draw one quad from two triangles:
 extern void glutil_draw_quad (void);
+
+// Render thread GL state. Calls that would not change the state are skipped.
+// Other code, such as the toolkit compositing the window, can change the
+// state behind our back, so the cache is reset at the start of every frame.
+// Binding a texture also selects its unit, since texture updates apply to the
+// active unit:
+extern void glutil_program      (const GLuint id);
+extern void glutil_vertex_array (const GLuint id);
+extern void glutil_texture      (const GLuint unit, const GLenum target, const GLuint id);
+extern void glutil_blend        (const bool enable);
+extern void glutil_depth_test   (const bool enable);
+extern void glutil_depth_mask   (const bool enable);
+extern void glutil_viewport     (const GLint x, const GLint y, const GLsizei width, const GLsizei height);
+extern void glutil_viewport_get (GLint viewport[4]);
+
+// Forget the cached state, for instance after deleting a bound object:
+extern void glutil_state_reset (void);
+
+// Start a new frame, and count the calls skipped in the previous one:
+extern void     glutil_state_frame  (void);
+extern uint32_t glutil_state_elided (void);
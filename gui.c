@@ -2,11 +2,10 @@
 #include <gdk/gdkkeysyms.h>
 
 #include "gui.h"
+#include "input.h"
 #include "util.h"
-#include "gui/framerate.h"
 #include "gui/local.h"
 #include "gui/signal.h"
-#include "layer/overview.h"
 
 static void
 on_key_press (GtkWidget *widget, GdkEventKey *event)
@@ -22,8 +21,11 @@ on_key_press (GtkWidget *widget, GdkEventKey *event)
 
 	case GDK_KEY_o:
 	case GDK_KEY_O:
-		layer_overview_toggle_visible();
-		framerate_repaint();
+		input_dispatch(&(struct input_event) {
+			.type  = INPUT_KEY,
+			.now   = (int64_t) event->time * 1000,
+			.value = 'o',
+		});
 		break;
 	}
 }
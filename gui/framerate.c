@@ -1,8 +1,11 @@
-#include "../pan.h"
-#include "../zoom.h"
+#include <stdatomic.h>
+
+#include "../input.h"
 #include "framerate.h"
 
-static bool repaint = true;
+// Set by any thread that wants a repaint, cleared by the frame clock. Requests
+// between two ticks coalesce into one repaint:
+static atomic_bool repaint = true;
 
 // Do this when the frame clock ticks:
 gboolean
@@ -12,20 +15,21 @@ framerate_on_tick (GtkWidget *glarea)
 	gint64 now = g_get_monotonic_time();
 
 	// Feed timer tick to worlds, query repaint:
-	repaint |= pan_on_tick(now);
-	repaint |= zoom_on_tick(now);
+	bool redraw = input_tick(now);
 
 	// Quit timer loop if canvas no longer exists:
 	if (!glarea || !GTK_IS_WIDGET(glarea))
 		return FALSE;
 
+	// Take the pending requests from other threads:
+	redraw |= atomic_exchange(&repaint, false);
+
 	// Yield if nothing to do:
-	if (!repaint)
+	if (!redraw)
 		return TRUE;
 
 	// Else queue the widget for drawing:
 	gtk_widget_queue_draw(glarea);
-	repaint = false;
 
 	return TRUE;
 }
@@ -34,5 +38,5 @@ framerate_on_tick (GtkWidget *glarea)
 void
 framerate_repaint (void)
 {
-	repaint = true;
+	atomic_store(&repaint, true);
 }
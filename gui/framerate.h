@@ -2,5 +2,6 @@
 
 #include <gtk/gtk.h>
 
+#include "../repaint.h"
+
 extern gboolean framerate_on_tick (GtkWidget *);
-extern void     framerate_repaint (void);
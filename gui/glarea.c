@@ -3,6 +3,7 @@
 #include <gtk/gtk.h>
 #include <GL/gl.h>
 
+#include "../input.h"
 #include "../util.h"
 #include "../viewport.h"
 #include "framerate.h"
@@ -40,8 +41,9 @@ on_render (GtkGLArea *glarea, GdkGLContext *context)
 {
 	UNUSED(glarea, context);
 
-	// Call the renderer:
-	viewport_paint();
+	// Call the renderer, and paint again if the frame was incomplete:
+	if (viewport_paint())
+		framerate_repaint();
 
 	// Don't propagate signal:
 	return TRUE;
@@ -71,6 +73,12 @@ on_resize (GtkGLArea *area, gint width, gint height)
 	UNUSED(area);
 
 	viewport_resize(width, height);
+
+	// Record the size, so that a replay unprojects the same positions:
+	input_dispatch(&(struct input_event) {
+		.type = INPUT_RESIZE,
+		.pos  = { .x = width, .y = height },
+	});
 }
 
 static void
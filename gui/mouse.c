@@ -1,19 +1,8 @@
-#include "../camera.h"
-#include "../pan.h"
+#include "../input.h"
 #include "../util.h"
 #include "../viewport.h"
-#include "../zoom.h"
-#include "framerate.h"
 #include "signal.h"
 
-#define BUTTON_LEFT	1
-#define BUTTON_CENTER	2
-#define BUTTON_RIGHT	3
-
-static int button_pressed = false;
-static struct viewport_pos button_pressed_pos;
-static int button_num;
-
 // Translate event coordinates to have origin in bottom left:
 // Use a macro and not an inline function because the basic GdkEvent
 // does not have x and y members:
@@ -35,12 +24,12 @@ on_button_press (GtkWidget *widget, GdkEventButton *event)
 {
 	event_get_pos;
 
-	button_pressed = true;
-	button_pressed_pos = pos;
-	button_num = event->button;
-
-	if (button_num == BUTTON_LEFT)
-		pan_on_button_down(&pos, evtime);
+	input_dispatch(&(struct input_event) {
+		.type  = INPUT_BUTTON_DOWN,
+		.now   = evtime,
+		.pos   = pos,
+		.value = event->button,
+	});
 
 	// Don't propagate further:
 	return TRUE;
@@ -51,33 +40,11 @@ on_button_motion (GtkWidget *widget, GdkEventButton *event)
 {
 	event_get_pos;
 
-	if (button_num == BUTTON_LEFT)
-		if (pan_on_button_move(&pos, evtime))
-			framerate_repaint();
-
-	if (button_num == BUTTON_RIGHT) {
-		const int dx = pos.x - button_pressed_pos.x;
-		const int dy = pos.y - button_pressed_pos.y;
-
-		if (dx != 0)
-			camera_set_rotate(dx * -0.005);
-
-		if (dy != 0)
-			camera_set_tilt(dy * 0.005);
-
-		framerate_repaint();
-	}
-
-	if (button_num == BUTTON_CENTER) {
-		const int dy = pos.y - button_pressed_pos.y;
-
-		if (dy != 0) {
-			camera_set_view_angle(camera_get()->view_angle + dy * -0.005);
-			framerate_repaint();
-		}
-	}
-
-	button_pressed_pos = pos;
+	input_dispatch(&(struct input_event) {
+		.type = INPUT_BUTTON_MOVE,
+		.now  = evtime,
+		.pos  = pos,
+	});
 
 	// Don't propagate further:
 	return TRUE;
@@ -86,14 +53,14 @@ on_button_motion (GtkWidget *widget, GdkEventButton *event)
 static gboolean
 on_button_release (GtkWidget *widget, GdkEventButton *event)
 {
-	if (!button_pressed)
-		return TRUE;
-
-	button_pressed = false;
 	event_get_pos;
 
-	if (event->button == BUTTON_LEFT)
-		pan_on_button_up(&pos, evtime);
+	input_dispatch(&(struct input_event) {
+		.type  = INPUT_BUTTON_UP,
+		.now   = evtime,
+		.pos   = pos,
+		.value = event->button,
+	});
 
 	// Don't propagate further:
 	return TRUE;
@@ -104,11 +71,12 @@ on_scroll (GtkWidget* widget, GdkEventScroll *event)
 {
 	(void) widget;
 
-	if (event->direction == GDK_SCROLL_UP)
-		zoom_in(evtime);
-
-	if (event->direction == GDK_SCROLL_DOWN)
-		zoom_out(evtime);
+	if (event->direction == GDK_SCROLL_UP || event->direction == GDK_SCROLL_DOWN)
+		input_dispatch(&(struct input_event) {
+			.type  = INPUT_SCROLL,
+			.now   = evtime,
+			.value = event->direction == GDK_SCROLL_UP ? 1 : -1,
+		});
 
 	// Don't propagate further:
 	return TRUE;
@@ -0,0 +1,345 @@
+// Render many views of the globe to PNG images in parallel, for instance to
+// generate thumbnails. Every worker process has its own offscreen context and
+// caches. The renderer keeps its state in globals, so it parallelizes across
+// processes, not threads.
+//
+// Usage: osymandias-batch [-j jobs] [-o dir] [-w timeout] [poses]
+//
+// The poses are read from a file, or from standard input. Each line holds a
+// view, in the same units as osymandias-render:
+//
+//   lat lon distance tilt rotate WxH [out.png]
+//
+// Views without a filename are saved as <dir>/<line>.png. Empty lines and
+// lines starting with '#' are skipped.
+//
+// The views are sorted along a space-filling curve, and handed to the workers
+// in runs of neighbouring views. A worker then finds most of the tiles for
+// its next view in its caches. The tile directory on disk is only read, so
+// the workers share it through the page cache.
+//
+// At the end, the throughput is reported in views per second per core used,
+// and in views per CPU second.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../util.h"
+#include "render.h"
+
+// Number of neighbouring views that a worker takes at once:
+#define RUN_LENGTH	8
+
+struct view {
+	struct render_pose pose;
+	uint32_t width;
+	uint32_t height;
+	uint64_t order;
+	char *path;
+};
+
+static struct {
+	struct view *view;
+	size_t used;
+	size_t size;
+} list;
+
+// Counters shared by all workers:
+struct shared {
+	atomic_size_t next;
+	atomic_size_t done;
+	atomic_size_t timeouts;
+	atomic_size_t failed;
+};
+
+static double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Position of a view on a Z-order curve over latitude and longitude, which
+// parse() has checked to be in range:
+static uint64_t
+order (const struct render_pose *pose)
+{
+	const uint32_t y = (pose->lat +  90.0) / 180.0 * 0xFFFF;
+	const uint32_t x = (pose->lon + 180.0) / 360.0 * 0xFFFF;
+	uint64_t z = 0;
+
+	for (int i = 0; i < 16; i++) {
+		z |= (uint64_t) ((x >> i) & 1) << (2 * i);
+		z |= (uint64_t) ((y >> i) & 1) << (2 * i + 1);
+	}
+
+	return z;
+}
+
+static int
+view_compare (const void *a, const void *b)
+{
+	const struct view *va = a, *vb = b;
+
+	return (va->order > vb->order) - (va->order < vb->order);
+}
+
+static bool
+list_grow (void)
+{
+	const size_t size = list.size ? list.size * 2 : 256;
+	struct view *view;
+
+	if ((view = realloc(list.view, size * sizeof (*view))) == NULL)
+		return false;
+
+	list.view = view;
+	list.size = size;
+	return true;
+}
+
+// Parse one line of the pose list. Returns false on a syntax error:
+static bool
+parse (const char *line, const size_t lineno, const char *dir, struct view *v)
+{
+	char path[4096];
+	int n;
+
+	*v = (struct view) { .pose.view_angle = 0.0 };
+
+	if (sscanf(line, "%lf %lf %lf %lf %lf %ux%u %n",
+			&v->pose.lat, &v->pose.lon, &v->pose.distance,
+			&v->pose.tilt, &v->pose.rotate,
+			&v->width, &v->height, &n) != 7)
+		return false;
+
+	if (v->width == 0 || v->height == 0)
+		return false;
+
+	// Out of range, the Z-order position is undefined. This also rejects
+	// NaN:
+	if (!(v->pose.lat >= -90.0 && v->pose.lat <= 90.0))
+		return false;
+
+	if (!(v->pose.lon >= -180.0 && v->pose.lon <= 180.0))
+		return false;
+
+	if (sscanf(line + n, "%4095s", path) == 1)
+		v->path = strdup(path);
+	else if (asprintf(&v->path, "%s/%zu.png", dir, lineno) < 0)
+		v->path = NULL;
+
+	v->order = order(&v->pose);
+	return v->path != NULL;
+}
+
+static bool
+list_read (FILE *f, const char *dir)
+{
+	size_t len = 0, lineno = 0;
+	char *line = NULL;
+	bool ret = true;
+
+	while (getline(&line, &len, f) != -1) {
+		const char *p = line + strspn(line, " \t");
+
+		lineno++;
+
+		if (*p == '#' || *p == '\n' || *p == '\0')
+			continue;
+
+		if (list.used == list.size && list_grow() == false) {
+			ret = false;
+			break;
+		}
+
+		if (parse(p, lineno, dir, &list.view[list.used]) == false) {
+			fprintf(stderr, "Line %zu: cannot parse pose\n", lineno);
+			ret = false;
+			break;
+		}
+
+		list.used++;
+	}
+
+	free(line);
+	return ret;
+}
+
+static void
+list_free (void)
+{
+	FOREACH_NELEM (list.view, list.used, v)
+		free(v->path);
+
+	free(list.view);
+}
+
+// Render runs of views until none are left:
+static int
+worker (struct shared *shared, const double timeout)
+{
+	size_t first;
+
+	if (render_init(list.view[0].width, list.view[0].height) == false) {
+		fprintf(stderr, "Cannot initialize offscreen renderer\n");
+		return 1;
+	}
+
+	while ((first = atomic_fetch_add(&shared->next, RUN_LENGTH)) < list.used) {
+		const size_t last = first + RUN_LENGTH < list.used ? first + RUN_LENGTH : list.used;
+
+		for (size_t i = first; i < last; i++) {
+			const struct view *v = &list.view[i];
+
+			if (render_resize(v->width, v->height) == false) {
+				atomic_fetch_add(&shared->failed, 1);
+				continue;
+			}
+
+			if (render_pose(&v->pose, timeout) == false)
+				atomic_fetch_add(&shared->timeouts, 1);
+
+			if (render_save(v->path) == false) {
+				fprintf(stderr, "Cannot write %s\n", v->path);
+				atomic_fetch_add(&shared->failed, 1);
+				continue;
+			}
+
+			atomic_fetch_add(&shared->done, 1);
+		}
+	}
+
+	render_destroy();
+	return 0;
+}
+
+static void
+usage (const char *name)
+{
+	fprintf(stderr, "Usage: %s [-j jobs] [-o dir] [-w timeout] [poses]\n", name);
+}
+
+int
+main (int argc, char **argv)
+{
+	const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	long jobs = cores;
+	const char *dir = ".";
+	double timeout = 30.0;
+	struct shared *shared;
+	struct rusage usage_children;
+	int opt, ret = 0;
+	long started = 0;
+	FILE *f = stdin;
+
+	while ((opt = getopt(argc, argv, "j:o:w:")) != -1) {
+		switch (opt) {
+		case 'j': jobs    = atol(optarg); break;
+		case 'o': dir     = optarg;       break;
+		case 'w': timeout = atof(optarg); break;
+
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind < argc - 1 || jobs < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (optind == argc - 1 && strcmp(argv[optind], "-") != 0)
+		if ((f = fopen(argv[optind], "r")) == NULL) {
+			fprintf(stderr, "Cannot open %s\n", argv[optind]);
+			return 1;
+		}
+
+	const bool ok = list_read(f, dir);
+
+	if (f != stdin)
+		fclose(f);
+
+	if (ok == false || list.used == 0) {
+		list_free();
+		return ok ? 0 : 1;
+	}
+
+	qsort(list.view, list.used, sizeof (*list.view), view_compare);
+
+	// Do not start more workers than there are runs of views:
+	if ((size_t) jobs > (list.used + RUN_LENGTH - 1) / RUN_LENGTH)
+		jobs = (list.used + RUN_LENGTH - 1) / RUN_LENGTH;
+
+	if ((shared = mmap(NULL, sizeof (*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		list_free();
+		return 1;
+	}
+
+	*shared = (struct shared) { .next = 0 };
+
+	// Fork the workers before any GL or thread state exists:
+	const double start = now();
+
+	for (; started < jobs; started++) {
+		const pid_t pid = fork();
+
+		if (pid == 0)
+			_exit(worker(shared, timeout));
+
+		if (pid < 0) {
+			fprintf(stderr, "Cannot start worker\n");
+			break;
+		}
+	}
+
+	for (long i = 0; i < started; i++) {
+		int status;
+
+		if (wait(&status) < 0)
+			break;
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ret = 1;
+	}
+
+	const double elapsed = now() - start;
+
+	getrusage(RUSAGE_CHILDREN, &usage_children);
+
+	const double cpu = usage_children.ru_utime.tv_sec + usage_children.ru_utime.tv_usec / 1e6
+	                 + usage_children.ru_stime.tv_sec + usage_children.ru_stime.tv_usec / 1e6;
+
+	const size_t done = atomic_load(&shared->done);
+	const long used = started < cores ? started : cores;
+
+	printf("%-10s %8s %8s %8s %10s %10s %12s %12s\n",
+		"workers", "views", "timeout", "failed", "wall s", "views/s", "views/s/core", "views/cpu s");
+	printf("%-10ld %8zu %8zu %8zu %10.3f %10.2f %12.2f %12.2f\n",
+		started, done,
+		atomic_load(&shared->timeouts),
+		atomic_load(&shared->failed),
+		elapsed,
+		done / elapsed,
+		used > 0 ? done / elapsed / used : 0.0,
+		cpu > 0.0 ? done / cpu : 0.0);
+
+	if (atomic_load(&shared->failed) > 0 || done < list.used)
+		ret = 1;
+
+	munmap(shared, sizeof (*shared));
+	list_free();
+	return ret;
+}
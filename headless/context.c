@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+
+#include "context.h"
+
+static struct {
+	EGLDisplay display;
+	EGLContext context;
+	GLuint     fbo;
+	GLuint     rbo[2];
+	uint32_t   width;
+	uint32_t   height;
+} ctx = {
+	.display = EGL_NO_DISPLAY,
+	.context = EGL_NO_CONTEXT,
+};
+
+bool
+context_create (const uint32_t width, const uint32_t height)
+{
+	static const EGLint attr[] = {
+		EGL_CONTEXT_MAJOR_VERSION,       4,
+		EGL_CONTEXT_MINOR_VERSION,       2,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE,
+	};
+
+	if ((ctx.display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL)) == EGL_NO_DISPLAY)
+		return false;
+
+	if (eglInitialize(ctx.display, NULL, NULL) == EGL_FALSE || eglBindAPI(EGL_OPENGL_API) == EGL_FALSE)
+		goto err0;
+
+	if ((ctx.context = eglCreateContext(ctx.display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attr)) == EGL_NO_CONTEXT)
+		goto err0;
+
+	if (eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx.context) == EGL_FALSE)
+		goto err1;
+
+	glGenFramebuffers(1, &ctx.fbo);
+	glGenRenderbuffers(2, ctx.rbo);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, ctx.fbo);
+
+	if (context_resize(width, height))
+		return true;
+
+	context_destroy();
+	return false;
+
+err1:	eglDestroyContext(ctx.display, ctx.context);
+	ctx.context = EGL_NO_CONTEXT;
+err0:	eglTerminate(ctx.display);
+	ctx.display = EGL_NO_DISPLAY;
+	return false;
+}
+
+bool
+context_resize (const uint32_t width, const uint32_t height)
+{
+	ctx.width  = width;
+	ctx.height = height;
+
+	// Reallocate the storage of the renderbuffers and attach them again:
+	glBindRenderbuffer(GL_RENDERBUFFER, ctx.rbo[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, ctx.rbo[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ctx.rbo[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_RENDERBUFFER, ctx.rbo[1]);
+
+	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+void
+context_read (uint8_t *rgba)
+{
+	const size_t stride = ctx.width * 4;
+	uint8_t *row;
+
+	glFinish();
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, ctx.width, ctx.height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+
+	// GL returns the bottom row first, swap the rows:
+	if ((row = malloc(stride)) == NULL)
+		return;
+
+	for (uint32_t y = 0; y < ctx.height / 2; y++) {
+		uint8_t *top = rgba + y * stride;
+		uint8_t *bot = rgba + (ctx.height - 1 - y) * stride;
+
+		memcpy(row, top, stride);
+		memcpy(top, bot, stride);
+		memcpy(bot, row, stride);
+	}
+
+	free(row);
+}
+
+void
+context_destroy (void)
+{
+	if (ctx.context == EGL_NO_CONTEXT)
+		return;
+
+	glDeleteFramebuffers(1, &ctx.fbo);
+	glDeleteRenderbuffers(2, ctx.rbo);
+
+	eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(ctx.display, ctx.context);
+	eglTerminate(ctx.display);
+
+	ctx.context = EGL_NO_CONTEXT;
+	ctx.display = EGL_NO_DISPLAY;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Create a surfaceless EGL context without a window system and make it
+// current, with an offscreen framebuffer of the given size to draw to. Like
+// the GTK build, this uses a compatibility profile.
+extern bool context_create (const uint32_t width, const uint32_t height);
+
+// Change the size of the offscreen framebuffer.
+extern bool context_resize (const uint32_t width, const uint32_t height);
+
+// Read the framebuffer as RGBA pixels, top row first.
+extern void context_read (uint8_t *rgba);
+
+extern void context_destroy (void);
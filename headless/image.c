@@ -0,0 +1,65 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <png.h>
+
+#include "image.h"
+
+static void
+encode (png_structp png, png_infop info, const uint8_t *rgba, const uint32_t width, const uint32_t height)
+{
+	png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB,
+		PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+	// Trade some file size for speed, this runs once per rendered view:
+	png_set_compression_level(png, 3);
+	png_write_info(png, info);
+
+	// Skip the alpha byte of every pixel:
+	png_set_filler(png, 0, PNG_FILLER_AFTER);
+
+	for (uint32_t y = 0; y < height; y++)
+		png_write_row(png, rgba + (size_t) y * width * 4);
+
+	png_write_end(png, NULL);
+}
+
+bool
+image_save (const char *path, const uint8_t *rgba, const uint32_t width, const uint32_t height)
+{
+	png_structp png;
+	png_infop info = NULL;
+	bool ret = false;
+	FILE *f;
+
+	if ((f = fopen(path, "wb")) == NULL)
+		return false;
+
+	if ((png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL)) == NULL)
+		goto err;
+
+	if ((info = png_create_info_struct(png)) == NULL)
+		goto err;
+
+	png_init_io(png, f);
+
+	// Return here on errors:
+	if (setjmp(png_jmpbuf(png))) {
+		ret = false;
+	} else {
+		encode(png, info, rgba, width, height);
+		ret = true;
+	}
+
+err:	png_destroy_write_struct(&png, &info);
+
+	if (fclose(f) != 0)
+		ret = false;
+
+	// Do not leave a partial image behind:
+	if (ret == false)
+		remove(path);
+
+	return ret;
+}
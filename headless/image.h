@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Write RGBA pixels, top row first, to a PNG file. The alpha channel is
+// dropped, the framebuffer is opaque.
+extern bool image_save (const char *path, const uint8_t *rgba, const uint32_t width, const uint32_t height);
@@ -0,0 +1,82 @@
+// Render a view of the globe without a window system, in an offscreen EGL
+// context, and save it as a PNG image. This works on headless machines with
+// a software renderer, so that rendering can be scripted and profiled.
+//
+// Usage: osymandias-render [-s WxH] [-p lat,lon] [-d distance] [-t tilt]
+//                          [-r rotate] [-a view angle] [-w timeout] out.png
+//
+// Angles are in degrees, the camera distance is in globe radii, as in the GUI,
+// and the timeout is in seconds. The view is saved when all its tiles are
+// drawn, or when the timeout expires.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "render.h"
+
+static void
+usage (const char *name)
+{
+	fprintf(stderr, "Usage: %s [-s WxH] [-p lat,lon] [-d distance] [-t tilt] "
+		"[-r rotate] [-a view angle] [-w timeout] out.png\n", name);
+}
+
+int
+main (int argc, char **argv)
+{
+	struct render_pose pose = { .distance = 1.0 };
+	uint32_t width = 640, height = 480;
+	double timeout = 30.0;
+	int opt, ret = 1;
+
+	while ((opt = getopt(argc, argv, "s:p:d:t:r:a:w:")) != -1) {
+		switch (opt) {
+		case 's':
+			if (sscanf(optarg, "%ux%u", &width, &height) != 2 || width == 0 || height == 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+
+		case 'p':
+			if (sscanf(optarg, "%lf,%lf", &pose.lat, &pose.lon) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+
+		case 'd': pose.distance   = atof(optarg); break;
+		case 't': pose.tilt       = atof(optarg); break;
+		case 'r': pose.rotate     = atof(optarg); break;
+		case 'a': pose.view_angle = atof(optarg); break;
+		case 'w': timeout         = atof(optarg); break;
+
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (render_init(width, height) == false) {
+		fprintf(stderr, "Cannot initialize offscreen renderer\n");
+		return 1;
+	}
+
+	if (render_pose(&pose, timeout) == false)
+		fprintf(stderr, "Timeout, saving incomplete view\n");
+
+	if (render_save(argv[optind]))
+		ret = 0;
+	else
+		fprintf(stderr, "Cannot write %s\n", argv[optind]);
+
+	render_destroy();
+	return ret;
+}
@@ -0,0 +1,129 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../bitmap_cache.h"
+#include "../camera.h"
+#include "../globe.h"
+#include "../repaint.h"
+#include "../viewport.h"
+#include "context.h"
+#include "image.h"
+#include "render.h"
+
+// Set by any thread that wants a repaint. The render loop clears it before
+// each frame and stops only when no request came in during the frame:
+static atomic_bool repaint = false;
+
+static double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void
+framerate_repaint (void)
+{
+	atomic_store(&repaint, true);
+}
+
+bool
+render_repaint_take (void)
+{
+	return atomic_exchange(&repaint, false);
+}
+
+bool
+render_init (const uint32_t width, const uint32_t height)
+{
+	if (context_create(width, height) == false)
+		return false;
+
+	if (viewport_init(width, height) == false) {
+		context_destroy();
+		return false;
+	}
+
+	viewport_resize(width, height);
+	return true;
+}
+
+bool
+render_resize (const uint32_t width, const uint32_t height)
+{
+	const struct viewport *vp = viewport_get();
+
+	if (vp->width == width && vp->height == height)
+		return true;
+
+	if (context_resize(width, height) == false)
+		return false;
+
+	viewport_resize(width, height);
+	return true;
+}
+
+bool
+render_pose (const struct render_pose *pose, const double timeout)
+{
+	const struct camera *cam = camera_get();
+	const double deadline = now() + timeout;
+
+	// The camera takes tilt and rotation relative to its current pose:
+	globe_moveto(pose->lat * M_PI / 180.0, pose->lon * M_PI / 180.0);
+	camera_set_distance(pose->distance);
+	camera_set_tilt(pose->tilt * M_PI / 180.0 - cam->tilt);
+	camera_set_rotate(pose->rotate * M_PI / 180.0 - cam->rotate);
+
+	if (pose->view_angle > 0.0)
+		camera_set_view_angle(pose->view_angle * M_PI / 180.0);
+
+	for (;;) {
+		atomic_store(&repaint, false);
+
+		const bool pending = viewport_paint();
+
+		// A loader pushes its tile and requests a repaint before the
+		// threadpool counts it as done, so check the requests last:
+		if (!pending && bitmap_cache_idle() && !atomic_load(&repaint))
+			return true;
+
+		if (now() > deadline)
+			return false;
+
+		// Leave the loader threads time, like a frame clock would:
+		if (!pending)
+			usleep(1000);
+	}
+}
+
+bool
+render_save (const char *path)
+{
+	const struct viewport *vp = viewport_get();
+	uint8_t *rgba;
+	bool ret;
+
+	if ((rgba = malloc((size_t) vp->width * vp->height * 4)) == NULL)
+		return false;
+
+	context_read(rgba);
+	ret = image_save(path, rgba, vp->width, vp->height);
+
+	free(rgba);
+	return ret;
+}
+
+void
+render_destroy (void)
+{
+	viewport_destroy();
+	context_destroy();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Camera pose of a view. Angles are in degrees.
+struct render_pose {
+	double lat;
+	double lon;
+	double distance;
+	double tilt;
+	double rotate;
+
+	// Horizontal view angle, or zero to keep the current angle.
+	double view_angle;
+};
+
+// Create an offscreen context of the given size and initialize the renderer
+// in it.
+extern bool render_init (const uint32_t width, const uint32_t height);
+
+// Change the size of the rendered image. Does nothing if the size is the same.
+extern bool render_resize (const uint32_t width, const uint32_t height);
+
+// Take the repaint requests since the last call, like the frame clock of the
+// GUI does. For callers that paint frames themselves.
+extern bool render_repaint_take (void);
+
+// Paint the view from a camera pose until all of its tiles are loaded and
+// drawn, or until the timeout in seconds expires. Returns false on timeout,
+// in which case the last frame may still show coarser tiles.
+extern bool render_pose (const struct render_pose *pose, const double timeout);
+
+// Save the last painted frame to a PNG file.
+extern bool render_save (const char *path);
+
+extern void render_destroy (void);
@@ -0,0 +1,352 @@
+// Replay a recorded input session in an offscreen context, and report frame
+// times, tile load latencies and cache hit rates. Record a session with
+// `osymandias -r session.rec`.
+//
+// Usage: osymandias-replay [-s WxH] [-f fps] [-n runs] [-w settle] session.rec
+//
+// The events are fed to the renderer on a simulated clock that ticks at a
+// fixed rate, so every run sees the same camera path, whatever the frame times
+// are. The clock is paced in real time, like the frame clock of the GUI, so
+// that the loader threads get the same time to load tiles as in a live
+// session. After the last event, the replay continues until the animations
+// have stopped and all tiles are loaded, or until the settle time in seconds
+// has passed.
+//
+// Every run is a fresh process that starts with empty caches, so that runs
+// can be compared with each other and with runs of other builds. Per run, it
+// reports the time of the painted frames including the GPU, the frames that
+// took longer than a tick, the tile load latency from request to arrival, the
+// fraction of bitmap lookups that found the requested tile, the tiles that
+// were prefetched and of those the ones that arrived in time and late, the
+// average time until the view was covered and until it was drawn at full
+// resolution after parts of it came up empty, the GL state calls per frame that
+// the state cache skipped, the texture data uploaded per frame on average and
+// at most, the uploads refused because the staging buffers were all in flight,
+// the highest number of decoded tile slots in use out of all slots, and the
+// time the view took to settle.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <GL/gl.h>
+
+#include "../bitmap_cache.h"
+#include "../glutil.h"
+#include "../input.h"
+#include "../layer/osm.h"
+#include "../pngloader.h"
+#include "../repaint.h"
+#include "../texture_stream.h"
+#include "../util.h"
+#include "../viewport.h"
+#include "render.h"
+
+static struct {
+	struct input_event *event;
+	size_t used;
+	size_t size;
+} list;
+
+static struct {
+	double *time;
+	size_t used;
+	size_t size;
+	uint64_t elided;
+	uint64_t upload;
+	size_t   upload_max;
+	size_t   refused;
+} frames;
+
+static int64_t
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+static bool
+list_read (FILE *f)
+{
+	struct input_event ev;
+
+	while (input_read(f, &ev)) {
+		if (list.used == list.size) {
+			const size_t size = list.size ? list.size * 2 : 1024;
+			struct input_event *event;
+
+			if ((event = realloc(list.event, size * sizeof (*event))) == NULL)
+				return false;
+
+			list.event = event;
+			list.size  = size;
+		}
+
+		list.event[list.used++] = ev;
+	}
+
+	return feof(f);
+}
+
+static bool
+frames_add (const double time)
+{
+	if (frames.used == frames.size) {
+		const size_t size = frames.size ? frames.size * 2 : 1024;
+		double *t;
+
+		if ((t = realloc(frames.time, size * sizeof (*t))) == NULL)
+			return false;
+
+		frames.time = t;
+		frames.size = size;
+	}
+
+	frames.time[frames.used++] = time;
+	return true;
+}
+
+static int
+time_compare (const void *a, const void *b)
+{
+	const double ta = *(const double *) a, tb = *(const double *) b;
+
+	return (ta > tb) - (ta < tb);
+}
+
+// Count the texture uploads of the last complete frame:
+static void
+uploads_add (void)
+{
+	const struct texture_stream_stats *s = texture_stream_stats();
+
+	frames.upload  += s->bytes;
+	frames.refused += s->refused;
+
+	if (s->bytes > frames.upload_max)
+		frames.upload_max = s->bytes;
+}
+
+// Paint one frame and time it, including the work of the GPU:
+static void
+paint (void)
+{
+	const int64_t start = now();
+
+	// The skipped calls and the uploads of a frame are counted at the
+	// start of the next:
+	if (frames.used > 0) {
+		frames.elided += glutil_state_elided();
+		uploads_add();
+	}
+
+	if (viewport_paint())
+		framerate_repaint();
+
+	glFinish();
+	frames_add((now() - start) / 1e3);
+}
+
+// Replay all events, then paint until the view settles. Returns the time in
+// msec from the last event until the view settled, or a negative number if it
+// did not settle in time:
+static double
+replay (const int64_t interval, const int64_t settle)
+{
+	const int64_t end = list.used ? list.event[list.used - 1].now : 0;
+	const int64_t start = now();
+	size_t next = 0;
+
+	// The GUI paints the first frame unconditionally:
+	framerate_repaint();
+
+	for (int64_t t = 0; ; t += interval) {
+
+		// Feed the events that are due at this tick:
+		for (; next < list.used && list.event[next].now <= t; next++) {
+			const struct input_event *ev = &list.event[next];
+
+			if (ev->type == INPUT_RESIZE)
+				render_resize(ev->pos.x, ev->pos.y);
+
+			input_dispatch(ev);
+		}
+
+		bool redraw = input_tick(t);
+		redraw |= render_repaint_take();
+
+		if (redraw)
+			paint();
+
+		if (next == list.used) {
+			if (!redraw && bitmap_cache_idle() && !render_repaint_take())
+				return (t - end) / 1e3;
+
+			if (t - end > settle)
+				return -1.0;
+		}
+
+		// Wait for the next tick of the simulated clock:
+		const int64_t wait = start + t + interval - now();
+
+		if (wait > 0)
+			usleep(wait);
+	}
+}
+
+static double
+percentile (const double *sorted, const size_t n, const double p)
+{
+	return n ? sorted[(size_t) (p * (n - 1))] : 0.0;
+}
+
+static int
+run (const int num, const uint32_t width, const uint32_t height, const int64_t interval, const int64_t settle)
+{
+	struct bitmap_cache_prefetch_stats prefetch;
+	struct bitmap_cache_stats stats;
+	struct layer_osm_progress progress;
+	struct pngloader_stats slots;
+	double sum = 0.0;
+	size_t missed = 0;
+
+	if (render_init(width, height) == false) {
+		fprintf(stderr, "Cannot initialize offscreen renderer\n");
+		return 1;
+	}
+
+	const double settled = replay(interval, settle);
+
+	// Close the last frame to count its uploads:
+	texture_stream_frame();
+	uploads_add();
+
+	bitmap_cache_stats(&stats);
+	bitmap_cache_prefetch_stats(&prefetch);
+	layer_osm_progress(&progress);
+	pngloader_stats(&slots);
+
+	FOREACH_NELEM (frames.time, frames.used, t) {
+		sum    += *t;
+		missed += *t > interval / 1e3;
+	}
+
+	qsort(frames.time, frames.used, sizeof (*frames.time), time_compare);
+
+	printf("%-4d %7zu %7.2f %7.2f %7.2f %7.2f %8.2f %7zu %7zu %9.1f %9.1f %7.1f%% %8zu %6zu/%-6zu %8.1f %8.1f %7.1f %8.1f %8.1f %7zu %6zu/%-6zu ",
+		num, frames.used,
+		frames.used ? sum / frames.used : 0.0,
+		percentile(frames.time, frames.used, 0.50),
+		percentile(frames.time, frames.used, 0.95),
+		percentile(frames.time, frames.used, 0.99),
+		frames.used ? frames.time[frames.used - 1] : 0.0,
+		missed, stats.loads,
+		stats.loads ? stats.latency * 1e3 / stats.loads : 0.0,
+		stats.latency_max * 1e3,
+		stats.searches ? 100.0 * stats.hits / stats.searches : 0.0,
+		prefetch.issued, prefetch.hits, prefetch.late,
+		progress.loads ? progress.coverage * 1e3 / progress.loads : 0.0,
+		progress.loads ? progress.final    * 1e3 / progress.loads : 0.0,
+		frames.used > 1 ? (double) frames.elided / (frames.used - 1) : 0.0,
+		frames.used ? frames.upload / 1024.0 / frames.used : 0.0,
+		frames.upload_max / 1024.0,
+		frames.refused,
+		slots.peak, slots.slots);
+
+	if (settled < 0.0)
+		printf("%9s\n", "timeout");
+	else
+		printf("%9.1f\n", settled);
+
+	fflush(stdout);
+	render_destroy();
+	return 0;
+}
+
+static void
+usage (const char *name)
+{
+	fprintf(stderr, "Usage: %s [-s WxH] [-f fps] [-n runs] [-w settle] session.rec\n", name);
+}
+
+int
+main (int argc, char **argv)
+{
+	uint32_t width = 600, height = 600;
+	double fps = 60.0, settle = 10.0;
+	int opt, runs = 1, ret = 0;
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "s:f:n:w:")) != -1) {
+		switch (opt) {
+		case 's':
+			if (sscanf(optarg, "%ux%u", &width, &height) != 2 || width == 0 || height == 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+
+		case 'f': fps    = atof(optarg); break;
+		case 'n': runs   = atoi(optarg); break;
+		case 'w': settle = atof(optarg); break;
+
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1 || fps <= 0.0 || runs < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if ((f = fopen(argv[optind], "r")) == NULL) {
+		fprintf(stderr, "Cannot open %s\n", argv[optind]);
+		return 1;
+	}
+
+	if (list_read(f) == false) {
+		fprintf(stderr, "%s: malformed event after %zu events\n", argv[optind], list.used);
+		fclose(f);
+		return 1;
+	}
+
+	fclose(f);
+
+	printf("%-4s %7s %7s %7s %7s %7s %8s %7s %7s %9s %9s %8s %8s %13s %8s %8s %7s %8s %8s %7s %13s %9s\n",
+		"run", "frames", "ms avg", "p50", "p95", "p99", "max", "missed",
+		"tiles", "lat avg", "lat max", "hits", "prefetch", "in time/late",
+		"cover ms", "final ms", "elided", "up KiB", "up max", "refused", "slots",
+		"settle ms");
+
+	// Run every replay in a fresh process, so that all runs start with the
+	// same state:
+	for (int i = 0; i < runs; i++) {
+		int status;
+		pid_t pid;
+
+		fflush(stdout);
+
+		if ((pid = fork()) < 0) {
+			fprintf(stderr, "Cannot start run\n");
+			ret = 1;
+			break;
+		}
+
+		if (pid == 0)
+			_exit(run(i + 1, width, height, 1e6 / fps, settle * 1e6));
+
+		if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ret = 1;
+	}
+
+	free(list.event);
+	return ret;
+}
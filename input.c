@@ -0,0 +1,212 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "camera.h"
+#include "input.h"
+#include "layer/overview.h"
+#include "pan.h"
+#include "prefetch.h"
+#include "repaint.h"
+#include "util.h"
+#include "zoom.h"
+
+static struct {
+	bool pressed;
+	int32_t num;
+	struct viewport_pos pos;
+} button;
+
+static struct {
+	FILE    *f;
+	bool     started;
+	int64_t  start;
+	int64_t  last;
+} record;
+
+// Event names in the recording, indexed by event type:
+static const char *names[] = {
+	[INPUT_BUTTON_DOWN] = "down",
+	[INPUT_BUTTON_MOVE] = "move",
+	[INPUT_BUTTON_UP]   = "up",
+	[INPUT_SCROLL]      = "scroll",
+	[INPUT_KEY]         = "key",
+	[INPUT_RESIZE]      = "resize",
+};
+
+static void
+record_write (const struct input_event *ev)
+{
+	if (record.f == NULL)
+		return;
+
+	// Resizes carry no time of their own, keep them in sequence:
+	if (ev->type != INPUT_RESIZE) {
+		if (record.started == false) {
+			record.started = true;
+			record.start   = ev->now;
+		}
+
+		record.last = ev->now - record.start;
+	}
+
+	fprintf(record.f, "%" PRId64 " %s %" PRId32 " %" PRId32 " %" PRId32 "\n",
+		record.last, names[ev->type], ev->value, ev->pos.x, ev->pos.y);
+}
+
+static void
+on_button_down (const struct input_event *ev)
+{
+	button.pressed = true;
+	button.pos     = ev->pos;
+	button.num     = ev->value;
+
+	if (button.num == INPUT_BUTTON_LEFT)
+		pan_on_button_down(&ev->pos, ev->now);
+}
+
+static void
+on_button_move (const struct input_event *ev)
+{
+	if (button.num == INPUT_BUTTON_LEFT)
+		if (pan_on_button_move(&ev->pos, ev->now))
+			framerate_repaint();
+
+	if (button.num == INPUT_BUTTON_RIGHT) {
+		const int dx = ev->pos.x - button.pos.x;
+		const int dy = ev->pos.y - button.pos.y;
+
+		if (dx != 0)
+			camera_set_rotate(dx * -0.005);
+
+		if (dy != 0)
+			camera_set_tilt(dy * 0.005);
+
+		framerate_repaint();
+	}
+
+	if (button.num == INPUT_BUTTON_CENTER) {
+		const int dy = ev->pos.y - button.pos.y;
+
+		if (dy != 0) {
+			camera_set_view_angle(camera_get()->view_angle + dy * -0.005);
+			framerate_repaint();
+		}
+	}
+
+	button.pos = ev->pos;
+}
+
+static void
+on_button_up (const struct input_event *ev)
+{
+	if (!button.pressed)
+		return;
+
+	button.pressed = false;
+
+	if (ev->value == INPUT_BUTTON_LEFT)
+		pan_on_button_up(&ev->pos, ev->now);
+}
+
+static void
+on_key (const struct input_event *ev)
+{
+	switch (ev->value) {
+	case 'o':
+	case 'O':
+		layer_overview_toggle_visible();
+		framerate_repaint();
+		break;
+	}
+}
+
+void
+input_dispatch (const struct input_event *ev)
+{
+	record_write(ev);
+
+	switch (ev->type) {
+	case INPUT_BUTTON_DOWN:
+		on_button_down(ev);
+		break;
+
+	case INPUT_BUTTON_MOVE:
+		on_button_move(ev);
+		break;
+
+	case INPUT_BUTTON_UP:
+		on_button_up(ev);
+		break;
+
+	case INPUT_SCROLL:
+		if (ev->value > 0)
+			zoom_in(ev->now);
+
+		if (ev->value < 0)
+			zoom_out(ev->now);
+
+		break;
+
+	case INPUT_KEY:
+		on_key(ev);
+		break;
+
+	case INPUT_RESIZE:
+		break;
+	}
+}
+
+bool
+input_tick (const int64_t now)
+{
+	// Feed timer tick to worlds, query repaint:
+	bool redraw = pan_on_tick(now);
+	redraw |= zoom_on_tick(now);
+
+	// Start loading the tiles for where the camera is heading:
+	prefetch_on_tick(now);
+
+	return redraw;
+}
+
+bool
+input_record_start (const char *path)
+{
+	if ((record.f = fopen(path, "w")) == NULL)
+		return false;
+
+	record.started = false;
+	record.last    = 0;
+	return true;
+}
+
+void
+input_record_stop (void)
+{
+	if (record.f == NULL)
+		return;
+
+	fclose(record.f);
+	record.f = NULL;
+}
+
+bool
+input_read (FILE *f, struct input_event *ev)
+{
+	char name[8];
+
+	if (fscanf(f, "%" SCNd64 " %7s %" SCNd32 " %" SCNd32 " %" SCNd32,
+			&ev->now, name, &ev->value, &ev->pos.x, &ev->pos.y) != 5)
+		return false;
+
+	for (size_t i = 0; i < NELEM(names); i++)
+		if (strcmp(name, names[i]) == 0) {
+			ev->type = i;
+			return true;
+		}
+
+	return false;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "viewport.h"
+
+#define INPUT_BUTTON_LEFT	1
+#define INPUT_BUTTON_CENTER	2
+#define INPUT_BUTTON_RIGHT	3
+
+enum input_type {
+	INPUT_BUTTON_DOWN,
+	INPUT_BUTTON_MOVE,
+	INPUT_BUTTON_UP,
+	INPUT_SCROLL,
+	INPUT_KEY,
+	INPUT_RESIZE,
+};
+
+// A user input event, independent of the toolkit.
+struct input_event {
+	enum input_type type;
+
+	// Event time in usec, on the same clock as the ticks.
+	int64_t now;
+
+	// Pointer position for button events, viewport size for resizes.
+	struct viewport_pos pos;
+
+	// Button number, scroll direction (positive to zoom in), or key.
+	int32_t value;
+};
+
+// Handle an input event, and record it if a recording is running. Resizes are
+// only recorded, the caller resizes the viewport.
+extern void input_dispatch (const struct input_event *event);
+
+// Advance the pan and zoom animations to the given time, and prefetch tiles
+// for where they are heading. Returns true if the view changed.
+extern bool input_tick (const int64_t now);
+
+// Record all dispatched events to a file, with times relative to the first
+// event. Returns false if the file cannot be created.
+extern bool input_record_start (const char *path);
+extern void input_record_stop  (void);
+
+// Read the next event from a recording. Returns false at the end of the file
+// or on a malformed line.
+extern bool input_read (FILE *f, struct input_event *event);
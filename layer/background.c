@@ -64,15 +64,14 @@ on_paint (const struct camera *cam, const struct viewport *vp)
 	// Use the background program:
 	program_bkgd_use();
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, tex.id);
+	glutil_texture(0, GL_TEXTURE_2D, tex.id);
 
 	// Copy vertices to buffer:
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertex), vertex, GL_STATIC_DRAW);
 
 	// Draw all triangles in the buffer:
-	glBindVertexArray(vao);
+	glutil_vertex_array(vao);
 	glutil_draw_quad();
 
 	program_none();
@@ -104,7 +103,7 @@ on_init (const struct viewport *vp)
 
 	// Bind buffer and vertex array:
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindVertexArray(vao);
+	glutil_vertex_array(vao);
 
 	// Link 'vertex' and 'texture' attributes:
 	glutil_vertex_uv_link(
@@ -18,8 +18,11 @@ static const struct glutil_vertex vertex[4] = {
 static void
 on_paint (const struct camera *cam, const struct viewport *vp)
 {
-	program_basemap_use(cam, vp);
-	glBindVertexArray(vao);
+	(void) cam;
+	(void) vp;
+
+	program_basemap_use();
+	glutil_vertex_array(vao);
 	glutil_draw_quad();
 	program_none();
 }
@@ -42,7 +45,7 @@ on_init (const struct viewport *vp)
 
 	// Bind buffer and vertex array:
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindVertexArray(vao);
+	glutil_vertex_array(vao);
 
 	// Link 'vertex' attribute:
 	glutil_vertex_link(program_basemap_loc_vertex());
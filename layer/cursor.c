@@ -45,10 +45,10 @@ on_paint (const struct camera *cam, const struct viewport *vp)
 	(void) vp;
 
 	// Viewport is screen:
-	glViewport(0, 0, screen.width, screen.height);
+	glutil_viewport(0, 0, screen.width, screen.height);
 
-	glDisable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
+	glutil_depth_test(false);
+	glutil_blend(true);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Use the cursor program:
@@ -57,11 +57,10 @@ on_paint (const struct camera *cam, const struct viewport *vp)
 	}));
 
 	// Activate cursor texture:
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, tex.id);
+	glutil_texture(0, GL_TEXTURE_2D, tex.id);
 
 	// Draw all triangles in the buffer:
-	glBindVertexArray(vao);
+	glutil_vertex_array(vao);
 	glutil_draw_quad();
 
 	program_none();
@@ -112,7 +111,7 @@ on_init (const struct viewport *vp)
 
 	// Bind buffer and vertex array:
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindVertexArray(vao);
+	glutil_vertex_array(vao);
 
 	// Link 'vertex' and 'texture' attributes:
 	glutil_vertex_uv_link(
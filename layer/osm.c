@@ -1,95 +1,451 @@
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #include <GL/gl.h>
 
 #include "../bitmap_cache.h"
+#include "../glutil.h"
 #include "../texture_cache.h"
+#include "../texture_stream.h"
 #include "../tiledrawer.h"
 #include "../tilepicker.h"
 #include "../layer.h"
 #include "../inlinebin.h"
 #include "../program.h"
+#include "../repaint.h"
+#include "../util.h"
+#include "osm.h"
+
+// Time budget for texture uploads per frame, in nanoseconds:
+#define UPLOAD_BUDGET	2000000.0
+
+// Video memory for the tile textures, in bytes:
+#define TEXTURE_VRAM	(64 * 1024 * 1024)
+
+// Number of timer queries in flight:
+#define TIMER_QUERIES	3
+
+// Let the loader threads upload the textures through shared contexts, where
+// the platform supports it:
+#ifndef LOADER_UPLOAD
+#define LOADER_UPLOAD	false
+#endif
+
+// A tile to draw this frame, with the texture it is drawn with, and possibly
+// a better bitmap that is waiting to be uploaded:
+struct draw {
+	struct cache_node in;
+	struct cache_node out;
+	struct cache_node out_bitmap;
+	const struct texture_cache *tex;
+	const struct bitmap_cache  *bitmap;
+	uint32_t coverage;
+};
+
+// Tiles to draw in the iteration order of the tilepicker, the tiles of the
+// previous visible set, and indices of the tiles with a pending upload:
+static struct {
+	struct draw *draw;
+	struct draw *prev;
+	size_t      *pending;
+	size_t       used;
+	size_t       size;
+	uint32_t     serial;
+} list;
+
+// Upload cost estimate, refined by GPU timer queries:
+static struct {
+	GLuint query[TIMER_QUERIES];
+	size_t bytes[TIMER_QUERIES];
+	size_t frame;
+	double ns_per_byte;
+} timer;
+
+// Loads that start with parts of the view not covered by any texture, with
+// the total time until the view is covered at any resolution, and until every
+// tile is drawn at its own resolution:
+static struct {
+	bool   loading;
+	bool   covered;
+	double start;
+	size_t loads;
+	double coverage;
+	double final;
+} progress;
 
 static bool
 on_init (const struct viewport *vp)
 {
 	(void) vp;
 
-	if (bitmap_cache_create())
-		return texture_cache_create();
+	if (bitmap_cache_create() == false)
+		return false;
 
-	bitmap_cache_destroy();
-	return false;
+	if (texture_cache_create(TEXTURE_VRAM) == false) {
+		bitmap_cache_destroy();
+		return false;
+	}
+
+	if (LOADER_UPLOAD && bitmap_cache_set_upload(true) == false)
+		fprintf(stderr, "Loader uploads not available, uploading from the render thread\n");
+
+	// Start with an estimate of 1 GB/s until measurements arrive:
+	glGenQueries(TIMER_QUERIES, timer.query);
+	timer.ns_per_byte = 1.0;
+	return true;
 }
 
 static void
 on_destroy (void)
 {
-	texture_cache_destroy();
+	glDeleteQueries(TIMER_QUERIES, timer.query);
+	tiledrawer_destroy();
+
+	// Stop the loader threads before the textures they upload to:
 	bitmap_cache_destroy();
+	texture_cache_destroy();
+	free(list.draw);
+	free(list.prev);
+	free(list.pending);
 }
 
-static const struct texture_cache *
-find_texture (const struct cache_node *in, struct cache_node *out)
+static bool
+list_grow (void)
 {
-	const struct bitmap_cache  *bitmap;
-	const struct texture_cache *tex;
-	struct cache_node out_bitmap, out_tex;
+	const size_t size = list.size ? list.size * 2 : 256;
+	struct draw *draw, *prev;
+	size_t *pending;
 
-	// Return true if the exact requested texture was found:
-	if ((tex = texture_cache_search(in, &out_tex)) != NULL)
-		if (in->zoom == out_tex.zoom) {
-			*out = out_tex;
-			return tex;
-		}
+	if ((draw = realloc(list.draw, size * sizeof (*draw))) == NULL)
+		return false;
+
+	list.draw = draw;
+
+	if ((prev = realloc(list.prev, size * sizeof (*prev))) == NULL)
+		return false;
+
+	list.prev = prev;
+
+	if ((pending = realloc(list.pending, size * sizeof (*pending))) == NULL)
+		return false;
+
+	list.pending = pending;
+	list.size    = size;
+	return true;
+}
+
+// Start timing the uploads of this frame. Returns the slot of the query, or
+// -1 if the query in the slot has not yet delivered its result.
+static int
+timer_start (void)
+{
+	const int slot = timer.frame++ % TIMER_QUERIES;
+
+	if (timer.bytes[slot] > 0) {
+		GLuint available;
+		GLuint64 ns;
+
+		glGetQueryObjectuiv(timer.query[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_FALSE)
+			return -1;
+
+		// Fold the measurement into a moving average:
+		glGetQueryObjectui64v(timer.query[slot], GL_QUERY_RESULT, &ns);
+		timer.ns_per_byte = 0.8 * timer.ns_per_byte + 0.2 * ns / timer.bytes[slot];
+		timer.bytes[slot] = 0;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, timer.query[slot]);
+	return slot;
+}
+
+static void
+timer_stop (const int slot, const size_t bytes)
+{
+	if (slot < 0)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	timer.bytes[slot] = bytes;
+}
+
+// Find the best texture that is already available for a tile. If the bitmap
+// cache has a better bitmap, record it for upload:
+static void
+find_texture (struct draw *d)
+{
+	struct cache_node out_tex;
+
+	d->tex    = texture_cache_search(&d->in, &out_tex);
+	d->out    = out_tex;
+	d->bitmap = NULL;
+
+	// Done if the exact requested texture was found:
+	if (d->tex != NULL && d->in.zoom == out_tex.zoom)
+		return;
 
 	// Otherwise try to find a bitmap of higher zoom:
-	bitmap_cache_lock();
-	if ((bitmap = bitmap_cache_search(in, &out_bitmap)) != NULL) {
-		if (tex == NULL || out_bitmap.zoom > out_tex.zoom) {
-			tex = texture_cache_insert(&out_bitmap, bitmap);
-			bitmap_cache_unlock();
-			*out = out_bitmap;
-			return tex;
+	if ((d->bitmap = bitmap_cache_search(&d->in, &d->out_bitmap)) != NULL)
+		if (d->tex != NULL && d->out_bitmap.zoom <= out_tex.zoom) {
+			bitmap_cache_release(d->bitmap);
+			d->bitmap = NULL;
 		}
+}
+
+// Check whether a tile is drawn with its own texture:
+static inline bool
+complete (const struct draw *d)
+{
+	return d->tex != NULL && d->out.zoom == d->in.zoom;
+}
+
+// Apply the changes to the visible set since the last paint. Tiles that were
+// already visible keep their state, tiles that entered the view start without
+// a texture, and tiles that left the view are given up on:
+static void
+list_update (void)
+{
+	const uint32_t serial = tilepicker_serial();
+	const struct tilepicker *left;
+	struct draw *draw = list.draw;
+	size_t nprev = list.used, nleft;
+
+	// If a result was skipped, the positions in the previous result do
+	// not refer to this list, so start over:
+	const bool full = serial != list.serial + 1;
+
+	list.draw   = list.prev;
+	list.prev   = draw;
+	list.used   = 0;
+	list.serial = serial;
+
+	for (const struct tilepicker *tile = tilepicker_first(); tile; tile = tilepicker_next()) {
+		if (list.used == list.size && list_grow() == false)
+			break;
+
+		struct draw *d = &list.draw[list.used++];
+		const int32_t p = full ? -1 : tilepicker_previous(tile);
+
+		if (p >= 0 && (size_t) p < nprev)
+			*d = list.prev[p];
+		else
+			*d = (struct draw) {
+				.in = {
+					.x    = tile->x,
+					.y    = tile->y,
+					.zoom = tile->zoom,
+				},
+			};
+
+		d->coverage = tilepicker_coverage(tile);
 	}
-	bitmap_cache_unlock();
 
-	// Else use whatever texture we have:
-	*out = out_tex;
-	return tex;
+	if (full)
+		return;
+
+	left = tilepicker_left(&nleft);
+
+	FOREACH_NELEM (left, nleft, t)
+		bitmap_cache_cancel(&(struct cache_node) {
+			.x    = t->x,
+			.y    = t->y,
+			.zoom = t->zoom,
+		});
+}
+
+// Upload order: tiles with nothing to draw first, then by descending screen
+// coverage, then by ascending zoom, since coarse tiles are ancestors of more
+// of the view:
+static int
+pending_compare (const void *a, const void *b)
+{
+	const struct draw *da = &list.draw[*(const size_t *) a];
+	const struct draw *db = &list.draw[*(const size_t *) b];
+
+	if ((da->tex == NULL) != (db->tex == NULL))
+		return da->tex == NULL ? -1 : 1;
+
+	if (da->coverage != db->coverage)
+		return da->coverage > db->coverage ? -1 : 1;
+
+	return (da->out_bitmap.zoom > db->out_bitmap.zoom)
+	     - (da->out_bitmap.zoom < db->out_bitmap.zoom);
+}
+
+static double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Time the current load, if any:
+static void
+progress_update (void)
+{
+	bool covered = true, final = true;
+
+	FOREACH_NELEM (list.draw, list.used, d) {
+		covered &= d->tex != NULL;
+		final   &= complete(d);
+	}
+
+	// A load starts when a part of the view has nothing to draw:
+	if (progress.loading == false) {
+		if (covered)
+			return;
+
+		progress.loading = true;
+		progress.covered = false;
+		progress.start   = now();
+		return;
+	}
+
+	if (covered && progress.covered == false) {
+		progress.covered   = true;
+		progress.coverage += now() - progress.start;
+	}
+
+	if (final) {
+		progress.loading = false;
+		progress.final  += now() - progress.start;
+		progress.loads++;
+	}
+}
+
+static size_t
+bitmap_size (const struct bitmap_cache *bitmap)
+{
+	return bitmap->palette ? 256 * 256 : 256 * 256 * 4;
+}
+
+// Upload pending bitmaps in order of priority until the budget is spent.
+// Tiles over budget keep drawing with their current texture. Returns the
+// number of bytes uploaded:
+static size_t
+upload (size_t npending)
+{
+	const double budget = UPLOAD_BUDGET / timer.ns_per_byte;
+	const int slot = timer_start();
+	size_t bytes = 0;
+
+	qsort(list.pending, npending, sizeof (*list.pending), pending_compare);
+
+	FOREACH_NELEM (list.pending, npending, p) {
+		struct draw *d = &list.draw[*p];
+		struct cache_node out_tex;
+		const struct texture_cache *tex;
+
+		// Another tile may have uploaded the same bitmap already:
+		if ((tex = texture_cache_search(&d->out_bitmap, &out_tex)) != NULL)
+			if (out_tex.zoom == d->out_bitmap.zoom)
+				continue;
+
+		// Always allow at least one upload per frame. Upload the rest
+		// in the next frame:
+		if (bytes > 0 && bytes + bitmap_size(d->bitmap) > budget) {
+			framerate_repaint();
+			break;
+		}
+
+		// The staging buffers are all in flight, try again next frame:
+		if (texture_cache_insert(&d->out_bitmap, d->bitmap) == NULL) {
+			framerate_repaint();
+			break;
+		}
+
+		bytes += bitmap_size(d->bitmap);
+	}
+
+	timer_stop(slot, bytes);
+	return bytes;
 }
 
 static void
 on_paint (const struct camera *cam, const struct viewport *vp)
 {
-	glDisable(GL_BLEND);
+	size_t npending = 0;
+	bool evicted;
+
+	(void) cam;
+	(void) vp;
 
-	// Load tiledrawer programs:
-	tiledrawer_start(cam, vp);
+	glutil_blend(false);
 
-	for (const struct tilepicker *tile = tilepicker_first(); tile; tile = tilepicker_next()) {
+	// Start counting texture uploads for this frame:
+	texture_stream_frame();
+
+	// Lock the bitmap cache only for the lookups. The bitmaps found hold a
+	// reference, so they cannot be evicted until they are uploaded:
+	bitmap_cache_lock();
+
+	// Take in the tiles that the loader threads finished. Adopting their
+	// textures can evict textures that complete tiles still point to:
+	evicted = bitmap_cache_drain();
+
+	if (list.serial != tilepicker_serial())
+		list_update();
 
-		// The tilepicker can tell us to draw a tile at a lower zoom
-		// level than the world zoom; scale the tile's coordinates to
-		// its native zoom level:
-		struct cache_node out, in = {
-			.x    = tile->x,
-			.y    = tile->y,
-			.zoom = tile->zoom,
-		};
+	// Look up textures and bitmaps only for tiles that are not yet drawn
+	// with their own texture. This includes the tiles that just entered:
+	FOREACH_NELEM (list.draw, list.used, d) {
+		if (complete(d))
+			continue;
 
+		find_texture(d);
+
+		if (d->bitmap != NULL)
+			list.pending[npending++] = d - list.draw;
+	}
+
+	bitmap_cache_unlock();
+
+	// Inserts can evict textures that were found above, so look them up
+	// again after uploading:
+	if (npending > 0 && upload(npending) > 0)
+		evicted = true;
+
+	if (evicted)
+		FOREACH_NELEM (list.draw, list.used, d)
+			d->tex = texture_cache_search(&d->in, &d->out);
+
+	// Release the bitmaps, uploaded or not:
+	FOREACH_NELEM (list.pending, npending, p) {
+		bitmap_cache_release(list.draw[*p].bitmap);
+		list.draw[*p].bitmap = NULL;
+	}
+
+	progress_update();
+
+	// Collect all tiles and draw them in one call:
+	tiledrawer_start();
+
+	FOREACH_NELEM (list.draw, list.used, d)
 		tiledrawer(&(struct tiledrawer) {
-			.tile = &out,
-			.tex  = find_texture(&in, &out),
+			.tile = &d->out,
+			.tex  = d->tex,
 		});
-	}
 
+	tiledrawer_end();
 	program_none();
 }
 
+void
+layer_osm_progress (struct layer_osm_progress *p)
+{
+	*p = (struct layer_osm_progress) {
+		.loads    = progress.loads,
+		.coverage = progress.coverage,
+		.final    = progress.final,
+	};
+}
+
 static struct layer layer = {
 	.name       = "Openstreetmap",
 	.zdepth     = 20,
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+
+// Loads that started with parts of the view not covered by any texture, and
+// the total time in seconds until the view was covered at any resolution, and
+// until every tile was drawn at its own resolution:
+struct layer_osm_progress {
+	size_t loads;
+	double coverage;
+	double final;
+};
+
+extern void layer_osm_progress (struct layer_osm_progress *progress);
@@ -53,6 +53,7 @@ static struct {
 	} pos;
 
 	uint32_t size;
+	bool     init;
 }
 state = {
 	.bkgd.vao    = &state.vao[0],
@@ -99,7 +100,7 @@ static void
 paint_background (GLuint vao)
 {
 	// Draw solid background:
-	glBindVertexArray(vao);
+	glutil_vertex_array(vao);
 	glBindBuffer(GL_ARRAY_BUFFER, *state.bkgd.vbo);
 	glutil_draw_quad();
 }
@@ -192,7 +193,7 @@ paint_tiles (void)
 		glBufferData(GL_ARRAY_BUFFER, sizeof(struct tile) * t, tile, GL_STREAM_DRAW);
 
 		// Draw indices:
-		glBindVertexArray(*state.tiles.vao);
+		glutil_vertex_array(*state.tiles.vao);
 		glDrawElements(GL_TRIANGLES, t * 6, GL_UNSIGNED_BYTE, index);
 
 		// Change colors to white:
@@ -210,58 +211,22 @@ paint_tiles (void)
 	}
 }
 
-static void
-on_paint (const struct camera *cam, const struct viewport *vp)
-{
-	(void) cam;
-
-	// Draw 1:1 to screen coordinates, origin bottom left:
-	glLineWidth(1.0);
-	glViewport(state.pos.x, state.pos.y, state.size, state.size);
-
-	glDisable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	// Paint background using solid program:
-	program_solid_use(&((struct program_solid) {
-		.matrix = matrix.proj32,
-	}));
-
-	paint_background(*state.bkgd.vao);
-
-	// Paint tiles using solid program:
-	paint_tiles();
-
-	// Paint background using frustum program:
-	program_frustum_use(&((struct program_frustum) {
-		.cam            = vp->cam_pos,
-		.mat_mvp_origin = vp->matrix32.modelviewproj_origin,
-		.mat_proj       = matrix.proj32,
-	}));
-
-	paint_background(*state.frustum.vao);
-
-	// Reset program:
-	program_none();
-
-	glDisable(GL_BLEND);
-
-	// Reset program:
-	program_none();
-}
-
 #define OFFSET_COORDS	((void *) offsetof(struct vertex, coords))
 #define OFFSET_COLOR	((void *) offsetof(struct vertex, color))
 
-static void
-add_pointer (unsigned int loc, int size, const void *ptr)
+// Fails if the program that provides the attribute could not be built:
+static bool
+add_pointer (GLint loc, int size, const void *ptr)
 {
+	if (loc < 0)
+		return false;
+
 	glEnableVertexAttribArray(loc);
 	glVertexAttribPointer(loc, size, GL_FLOAT, GL_FALSE, sizeof (struct vertex), ptr);
+	return true;
 }
 
-static void
+static bool
 init_bkgd (void)
 {
 	// Background quad is array of counterclockwise vertices:
@@ -279,35 +244,78 @@ init_bkgd (void)
 
 	// Bind buffer and vertex array, upload vertices:
 	glBindBuffer(GL_ARRAY_BUFFER, *state.bkgd.vbo);
-	glBindVertexArray(*state.bkgd.vao);
+	glutil_vertex_array(*state.bkgd.vao);
 	glBufferData(GL_ARRAY_BUFFER, sizeof (bkgd), bkgd, GL_STATIC_DRAW);
 
 	// Add pointer to 'vertex' and 'color' attributes:
-	add_pointer(program_solid_loc_vertex(), 2, OFFSET_COORDS);
-	add_pointer(program_solid_loc_color(),  4, OFFSET_COLOR);
+	return add_pointer(program_solid_loc_vertex(), 2, OFFSET_COORDS)
+	    && add_pointer(program_solid_loc_color(),  4, OFFSET_COLOR);
 }
 
-static void
+static bool
 init_frustum (void)
 {
 	// Bind buffer and vertex array (reuse the background quad):
 	glBindBuffer(GL_ARRAY_BUFFER, *state.bkgd.vbo);
-	glBindVertexArray(*state.frustum.vao);
+	glutil_vertex_array(*state.frustum.vao);
 
 	// Add pointer to 'vertex' attribute:
-	add_pointer(program_frustum_loc_vertex(), 2, OFFSET_COORDS);
+	return add_pointer(program_frustum_loc_vertex(), 2, OFFSET_COORDS);
 }
 
-static void
+static bool
 init_tiles (void)
 {
 	// Bind buffer and vertex array:
 	glBindBuffer(GL_ARRAY_BUFFER, *state.tiles.vbo);
-	glBindVertexArray(*state.tiles.vao);
+	glutil_vertex_array(*state.tiles.vao);
 
 	// Add pointer to 'vertex' and 'color' attributes:
-	add_pointer(program_solid_loc_vertex(), 2, OFFSET_COORDS);
-	add_pointer(program_solid_loc_color(),  4, OFFSET_COLOR);
+	return add_pointer(program_solid_loc_vertex(), 2, OFFSET_COORDS)
+	    && add_pointer(program_solid_loc_color(),  4, OFFSET_COLOR);
+}
+
+static void
+on_paint (const struct camera *cam, const struct viewport *vp)
+{
+	(void) cam;
+	(void) vp;
+
+	// Lazy init, so that the programs are built only when the overview
+	// is first shown. Draw nothing if they fail to build:
+	if (state.init == false) {
+		if (!init_bkgd() || !init_frustum() || !init_tiles())
+			return;
+
+		state.init = true;
+	}
+
+	// Draw 1:1 to screen coordinates, origin bottom left:
+	glLineWidth(1.0);
+	glutil_viewport(state.pos.x, state.pos.y, state.size, state.size);
+
+	glutil_depth_test(false);
+	glutil_blend(true);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	// Paint background and tiles using solid program:
+	if (program_solid_use(&((struct program_solid) {
+		.matrix = matrix.proj32,
+	}))) {
+		paint_background(*state.bkgd.vao);
+		paint_tiles();
+	}
+
+	// Paint background using frustum program:
+	if (program_frustum_use(&((struct program_frustum) {
+		.mat_proj = matrix.proj32,
+	})))
+		paint_background(*state.frustum.vao);
+
+	glutil_blend(false);
+
+	// Reset program:
+	program_none();
 }
 
 static bool
@@ -319,10 +327,6 @@ on_init (const struct viewport *vp)
 	glGenBuffers(NELEM(state.vbo), state.vbo);
 	glGenVertexArrays(NELEM(state.vao), state.vao);
 
-	init_bkgd();
-	init_frustum();
-	init_tiles();
-
 	return true;
 }
 
@@ -1,16 +1,39 @@
+#include <stdio.h>
+#include <unistd.h>
+
 #include "gui.h"
+#include "input.h"
 
 // Application entry point
 int
 main (int argc, char **argv)
 {
+	int opt;
+
 	// Initialize GUI:
 	if (!gui_init(&argc, &argv))
 		return 1;
 
+	// Parse the options that GTK left, record the input if asked:
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			if (!input_record_start(optarg)) {
+				fprintf(stderr, "Cannot create %s\n", optarg);
+				return 1;
+			}
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-r recording]\n", argv[0]);
+			return 1;
+		}
+	}
+
 	// Run GUI:
 	if (!gui_run())
 		return 1;
 
+	input_record_stop();
 	return 0;
 }
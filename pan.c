@@ -279,3 +279,42 @@ pan_on_tick (const int64_t now)
 		return false;
 	}
 }
+
+bool
+pan_predict (const int64_t now, const int64_t ahead, double *lat, double *lon)
+{
+	const struct camera *cam = camera_get();
+	const struct globe *globe = globe_get();
+
+	switch (state.state) {
+	case STATE_DRAG:
+
+		// Assume that the drag continues at the current speed:
+		*lat = globe->lat + state.speed.lat * ahead * cam->distance;
+		*lon = globe->lon + state.speed.lon * ahead * cam->distance;
+		return true;
+
+	case STATE_PAN: {
+
+		// Every tick moves by speed * dt * distance / ease, with the
+		// easing factor sqrt(t / 1e5). Integrate over the time ahead:
+		const double t0 = now - state.pan.start;
+		const double t1 = t0 + ahead;
+		const double f  = 2.0 * sqrt(1e5) * (sqrt(t1) - sqrt(t0)) * cam->distance;
+
+		*lat = globe->lat + state.speed.lat * f;
+		*lon = globe->lon + state.speed.lon * f;
+		return true;
+	}
+
+	case STATE_MOVETO:
+
+		// A move-to reaches its target within half a second:
+		*lat = state.moveto.lat;
+		*lon = state.moveto.lon;
+		return true;
+
+	default:
+		return false;
+	}
+}
@@ -9,3 +9,7 @@ extern bool pan_on_tick        (const int64_t now);
 extern void pan_on_button_down (const struct viewport_pos *pos, const int64_t now);
 extern bool pan_on_button_move (const struct viewport_pos *pos, const int64_t now);
 extern void pan_on_button_up   (const struct viewport_pos *pos, const int64_t now);
+
+// Extrapolate the cursor position some time ahead along the current drag, pan
+// or move-to. Returns false if the globe is not moving.
+extern bool pan_predict (const int64_t now, const int64_t ahead, double *lat, double *lon);
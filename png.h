@@ -4,6 +4,22 @@
 #include <stdint.h>
 #include <stddef.h>
 
+struct png_out;
+
+// Decoder backends.
+enum png_backend {
+
+	// Use the fastest backend that supports the image.
+	PNG_BACKEND_AUTO,
+
+	// Always use libpng.
+	PNG_BACKEND_LIBPNG,
+
+	// Use the built-in decoder, which handles only the common case of
+	// non-interlaced 8-bit images. Fails on anything else.
+	PNG_BACKEND_INFLATE,
+};
+
 // Input structure: describes a blob of PNG data,
 struct png_in {
 
@@ -15,6 +31,26 @@ struct png_in {
 
 	// Length of the raw PNG data blob in bytes.
 	size_t len;
+
+	// Optional allocator for the decoded pixel data. It is called with the
+	// geometry of the output image, and must return a buffer of at least
+	// png_out_size() bytes, or NULL to reject the image. If not set,
+	// malloc() is used.
+	void *(* alloc) (const struct png_out *out);
+
+	// Counterpart of the allocator above. If not set, free() is used.
+	void (* free) (void *buf);
+
+	// Decoder backend to use, default PNG_BACKEND_AUTO.
+	enum png_backend backend;
+
+	// Keep paletted images as one index byte per pixel plus a
+	// palette, instead of expanding them to RGB.
+	bool indexed;
+
+	// Output RGBA with opaque alpha instead of RGB. Rows are then a
+	// multiple of four bytes, which GL can upload without repacking.
+	bool rgba;
 };
 
 // Output structure: describes a decoded blob of raw image pixel data.
@@ -29,8 +65,25 @@ struct png_out {
 	// Width of the image in pixels.
 	uint16_t width;
 
-	// Number of color channels in the image pixel data.
+	// Number of color channels in the image pixel data: 3 for RGB, 4 for
+	// RGBA, or 1 for indexed images.
 	uint8_t channels;
+
+	// Palette of an indexed image, NULL otherwise. It is stored in the
+	// same buffer, directly after the pixel data. Unused entries are black.
+	uint8_t (*palette)[3];
 };
 
+// Size of the palette of an indexed image in bytes.
+#define PNG_PALETTE_SIZE	(256 * 3)
+
+// Size of the output buffer in bytes, including the palette if any.
+static inline size_t
+png_out_size (const struct png_out *out)
+{
+	const size_t size = (size_t) out->height * out->width * out->channels;
+
+	return out->channels == 1 ? size + PNG_PALETTE_SIZE : size;
+}
+
 extern bool png_load (const struct png_in *in, struct png_out *out);
@@ -0,0 +1,541 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "../png.h"
+#include "local.h"
+
+// Build a chunk type from its four ASCII letters:
+#define CHUNK(a, b, c, d) \
+	((uint32_t) (a) << 24 | (uint32_t) (b) << 16 | (uint32_t) (c) << 8 | (uint32_t) (d))
+
+#define CHUNK_IHDR	CHUNK('I', 'H', 'D', 'R')
+#define CHUNK_PLTE	CHUNK('P', 'L', 'T', 'E')
+#define CHUNK_IDAT	CHUNK('I', 'D', 'A', 'T')
+#define CHUNK_IEND	CHUNK('I', 'E', 'N', 'D')
+#define CHUNK_tRNS	CHUNK('t', 'R', 'N', 'S')
+
+// Chunks with a lowercase first letter are ancillary and can be skipped:
+#define CHUNK_ANCILLARY(type)	((type) & 0x20000000)
+
+// Row padding, so that a whole pixel can be loaded at the end of a row:
+#define ROW_PAD		4
+
+enum color_type {
+	COLOR_GRAY       = 0,
+	COLOR_RGB        = 2,
+	COLOR_PALETTE    = 3,
+	COLOR_GRAY_ALPHA = 4,
+	COLOR_RGBA       = 6,
+};
+
+enum filter {
+	FILTER_NONE,
+	FILTER_SUB,
+	FILTER_UP,
+	FILTER_AVERAGE,
+	FILTER_PAETH,
+};
+
+// One pixel of up to four bytes, widened to 16-bit lanes for arithmetic:
+typedef uint8_t v4u8  __attribute__((vector_size(4)));
+typedef int16_t v4i16 __attribute__((vector_size(8)));
+
+struct chunk {
+	uint32_t       type;
+	uint32_t       len;
+	const uint8_t *data;
+};
+
+// Local state structure.
+struct state {
+
+	// Read pointer and end of the input data.
+	const uint8_t *cur;
+	const uint8_t *end;
+
+	// Image header fields.
+	uint32_t width;
+	uint32_t height;
+	uint8_t  depth;
+	uint8_t  color;
+	uint8_t  interlace;
+
+	// Bytes per pixel and per row in the decompressed data.
+	size_t bpp;
+	size_t stride;
+
+	// Palette, unused entries are black.
+	uint8_t  palette[256][3];
+	uint32_t palette_len;
+
+	// Whether to output palette indices instead of RGB.
+	bool indexed;
+
+	// Bytes per pixel in the output.
+	size_t channels;
+};
+
+// Per-thread decompression state and scratch buffer, reused between calls to
+// avoid allocating and freeing them for every image:
+static _Thread_local struct {
+	z_stream zs;
+	bool     zs_init;
+	uint8_t *buf;
+	size_t   len;
+} scratch;
+
+static inline uint32_t
+be32 (const uint8_t *p)
+{
+	return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+// Get the next chunk from the input and check its CRC.
+static bool
+chunk_next (struct state *state, struct chunk *chunk)
+{
+	// A chunk has at least a length, a type and a CRC:
+	if (state->end - state->cur < 12)
+		return false;
+
+	chunk->len  = be32(state->cur + 0);
+	chunk->type = be32(state->cur + 4);
+	chunk->data = state->cur + 8;
+
+	if (chunk->len > (size_t) (state->end - state->cur) - 12)
+		return false;
+
+	// The CRC covers the type and the data:
+	if (crc32(0, state->cur + 4, chunk->len + 4) != be32(chunk->data + chunk->len))
+		return false;
+
+	state->cur += chunk->len + 12;
+	return true;
+}
+
+static bool
+parse_ihdr (struct state *state, const struct chunk *chunk)
+{
+	static const uint8_t channels[] = {
+		[COLOR_GRAY]       = 1,
+		[COLOR_RGB]        = 3,
+		[COLOR_PALETTE]    = 1,
+		[COLOR_GRAY_ALPHA] = 2,
+		[COLOR_RGBA]       = 4,
+	};
+
+	if (chunk->type != CHUNK_IHDR || chunk->len != 13)
+		return false;
+
+	state->width     = be32(chunk->data + 0);
+	state->height    = be32(chunk->data + 4);
+	state->depth     = chunk->data[8];
+	state->color     = chunk->data[9];
+	state->interlace = chunk->data[12];
+
+	// The output structure has 16-bit dimensions:
+	if (state->width == 0 || state->width > UINT16_MAX)
+		return false;
+
+	if (state->height == 0 || state->height > UINT16_MAX)
+		return false;
+
+	// Only handle the common case of non-interlaced 8-bit images:
+	if (state->depth != 8 || state->interlace != 0)
+		return false;
+
+	// Compression and filter method must be zero:
+	if (chunk->data[10] != 0 || chunk->data[11] != 0)
+		return false;
+
+	if (state->color >= sizeof (channels) || channels[state->color] == 0)
+		return false;
+
+	state->bpp    = channels[state->color];
+	state->stride = state->bpp * state->width;
+	return true;
+}
+
+static bool
+parse_plte (struct state *state, const struct chunk *chunk)
+{
+	if (chunk->len == 0 || chunk->len % 3 || chunk->len > sizeof (state->palette))
+		return false;
+
+	state->palette_len = chunk->len / 3;
+	memcpy(state->palette, chunk->data, chunk->len);
+	return true;
+}
+
+// Decompress the consecutive run of IDAT chunks starting with #chunk.
+static bool
+inflate_idat (struct state *state, struct chunk *chunk, uint8_t *raw, size_t len)
+{
+	z_stream *zs = &scratch.zs;
+	int ret = Z_OK;
+
+	if (scratch.zs_init == false) {
+		if (inflateInit(zs) != Z_OK)
+			return false;
+
+		scratch.zs_init = true;
+	}
+	else if (inflateReset(zs) != Z_OK)
+		return false;
+
+	zs->next_out  = raw;
+	zs->avail_out = len;
+
+	for (;;) {
+		zs->next_in  = (uint8_t *) chunk->data;
+		zs->avail_in = chunk->len;
+
+		if ((ret = inflate(zs, Z_NO_FLUSH)) != Z_OK && ret != Z_BUF_ERROR)
+			break;
+
+		if (chunk_next(state, chunk) == false)
+			return false;
+
+		if (chunk->type != CHUNK_IDAT)
+			break;
+	}
+
+	// The stream must end exactly at the end of the image data:
+	if (ret != Z_STREAM_END || zs->avail_out != 0 || zs->avail_in != 0)
+		return false;
+
+	// Move past the last IDAT chunk. Only empty ones may follow:
+	do {
+		if (chunk_next(state, chunk) == false)
+			return false;
+
+	} while (chunk->type == CHUNK_IDAT && chunk->len == 0);
+
+	return chunk->type != CHUNK_IDAT;
+}
+
+static inline v4i16
+pixel_load (const uint8_t *p)
+{
+	v4u8 v;
+
+	memcpy(&v, p, sizeof (v));
+	return __builtin_convertvector(v, v4i16);
+}
+
+static inline void
+pixel_store (uint8_t *p, const v4i16 v, const size_t bpp)
+{
+	const v4u8 u = __builtin_convertvector(v, v4u8);
+
+	memcpy(p, &u, bpp);
+}
+
+static inline v4i16
+vabs (const v4i16 v)
+{
+	const v4i16 sign = v >> 15;
+
+	return (v ^ sign) - sign;
+}
+
+// Paeth predictor on all channels of a pixel at once. Vector comparisons
+// yield all-ones for true, so the results can be used as select masks.
+static inline v4i16
+paeth_vec (const v4i16 a, const v4i16 b, const v4i16 c)
+{
+	const v4i16 pa = vabs(b - c);
+	const v4i16 pb = vabs(a - c);
+	const v4i16 pc = vabs(a + b - c - c);
+
+	const v4i16 use_a = (pa <= pb) & (pa <= pc);
+	const v4i16 use_b = ~use_a & (pb <= pc);
+
+	return (a & use_a) | (b & use_b) | (c & ~(use_a | use_b));
+}
+
+static inline uint8_t
+paeth (const int a, const int b, const int c)
+{
+	const int pa = abs(b - c);
+	const int pb = abs(a - c);
+	const int pc = abs(a + b - c - c);
+
+	if (pa <= pb && pa <= pc)
+		return a;
+
+	return pb <= pc ? b : c;
+}
+
+// Reconstruct a row of three or four bytes per pixel. The left neighbour is
+// carried in a register and all channels are processed in parallel.
+static inline void
+unfilter_vec (uint8_t *cur, const uint8_t *prev, const size_t stride, const size_t bpp, const enum filter filter)
+{
+	v4i16 a = { 0 }, c = { 0 };
+
+	for (size_t i = 0; i < stride; i += bpp) {
+		const v4i16 x = pixel_load(cur + i);
+		const v4i16 b = pixel_load(prev + i);
+
+		switch (filter) {
+		case FILTER_SUB:     a = x + a;                   break;
+		case FILTER_AVERAGE: a = x + ((a + b) >> 1);      break;
+		case FILTER_PAETH:   a = x + paeth_vec(a, b, c);  break;
+		default:                                          break;
+		}
+
+		a &= 0xFF;
+		c  = b;
+		pixel_store(cur + i, a, bpp);
+	}
+}
+
+// Reconstruct a row of one or two bytes per pixel.
+static inline void
+unfilter_scalar (uint8_t *cur, const uint8_t *prev, const size_t stride, const size_t bpp, const enum filter filter)
+{
+	for (size_t i = 0; i < stride; i++) {
+		const int a = i >= bpp ? cur[i - bpp]  : 0;
+		const int c = i >= bpp ? prev[i - bpp] : 0;
+
+		switch (filter) {
+		case FILTER_SUB:     cur[i] += a;                  break;
+		case FILTER_AVERAGE: cur[i] += (a + prev[i]) >> 1; break;
+		case FILTER_PAETH:   cur[i] += paeth(a, prev[i], c); break;
+		default:                                           break;
+		}
+	}
+}
+
+static bool
+unfilter (uint8_t *cur, const uint8_t *prev, const size_t stride, const size_t bpp, const uint8_t filter)
+{
+	switch (filter) {
+	case FILTER_NONE:
+		return true;
+
+	case FILTER_UP:
+		for (size_t i = 0; i < stride; i++)
+			cur[i] += prev[i];
+
+		return true;
+
+	case FILTER_SUB:
+	case FILTER_AVERAGE:
+	case FILTER_PAETH:
+		if (bpp >= 3)
+			unfilter_vec(cur, prev, stride, bpp, filter);
+		else
+			unfilter_scalar(cur, prev, stride, bpp, filter);
+
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// Convert one reconstructed row to RGB or RGBA, the same way as the libpng
+// backend. The alpha channel of the output is always opaque.
+static bool
+convert (const struct state *state, uint8_t *dst, const uint8_t *src)
+{
+	const bool rgba = state->channels == 4;
+
+	switch (state->color) {
+	case COLOR_RGB:
+		if (rgba)
+			png_rgb_to_rgba(dst, src, state->width);
+		else
+			memcpy(dst, src, state->stride);
+
+		return true;
+
+	case COLOR_RGBA:
+		if (rgba) {
+			memcpy(dst, src, state->stride);
+
+			for (uint32_t x = 0; x < state->width; x++)
+				dst[x * 4 + 3] = 0xFF;
+		}
+		else for (uint32_t x = 0; x < state->width; x++, src += 4, dst += 3)
+			memcpy(dst, src, 3);
+
+		return true;
+
+	case COLOR_GRAY:
+	case COLOR_GRAY_ALPHA:
+		for (uint32_t x = 0; x < state->width; x++, src += state->bpp, dst += state->channels) {
+			dst[0] = dst[1] = dst[2] = src[0];
+
+			if (rgba)
+				dst[3] = 0xFF;
+		}
+
+		return true;
+
+	case COLOR_PALETTE: {
+		uint8_t max = 0;
+
+		if (state->indexed) {
+			memcpy(dst, src, state->width);
+
+			for (uint32_t x = 0; x < state->width; x++)
+				max = src[x] > max ? src[x] : max;
+		}
+		else for (uint32_t x = 0; x < state->width; x++, dst += state->channels) {
+			memcpy(dst, state->palette[src[x]], 3);
+			max = src[x] > max ? src[x] : max;
+
+			if (rgba)
+				dst[3] = 0xFF;
+		}
+
+		// Leave out-of-range indices to libpng's judgement:
+		return max < state->palette_len;
+	}
+
+	default:
+		return false;
+	}
+}
+
+// Get a scratch buffer of at least the given size.
+static uint8_t *
+scratch_get (const size_t len)
+{
+	if (scratch.len < len) {
+		uint8_t *buf;
+
+		if ((buf = realloc(scratch.buf, len)) == NULL)
+			return NULL;
+
+		scratch.buf = buf;
+		scratch.len = len;
+	}
+
+	return scratch.buf;
+}
+
+static bool
+load (struct state *state, const struct png_in *in, struct png_out *out)
+{
+	struct chunk chunk;
+
+	// The header must be the first chunk:
+	if (chunk_next(state, &chunk) == false || parse_ihdr(state, &chunk) == false)
+		return false;
+
+	// Walk the chunks up to the image data:
+	for (;;) {
+		if (chunk_next(state, &chunk) == false)
+			return false;
+
+		if (chunk.type == CHUNK_IDAT)
+			break;
+
+		switch (chunk.type) {
+		case CHUNK_PLTE:
+			if (parse_plte(state, &chunk) == false)
+				return false;
+
+			break;
+
+		// Transparent palette entries make libpng output RGBA:
+		case CHUNK_tRNS:
+			if (state->color == COLOR_PALETTE)
+				return false;
+
+			break;
+
+		default:
+			if (CHUNK_ANCILLARY(chunk.type) == 0)
+				return false;
+
+			break;
+		}
+	}
+
+	if (state->color == COLOR_PALETTE && state->palette_len == 0)
+		return false;
+
+	// The decompressed data is one filter byte plus the pixels per row. A
+	// zeroed row precedes it as the row above the first row:
+	const size_t rowlen = state->stride + 1;
+	const size_t rawlen = rowlen * state->height;
+	uint8_t *zero, *raw;
+
+	// The decompressor counts in 32-bit quantities:
+	if (rawlen > UINT32_MAX)
+		return false;
+
+	if ((zero = scratch_get(rowlen + rawlen + ROW_PAD)) == NULL)
+		return false;
+
+	memset(zero, 0, rowlen);
+	raw = zero + rowlen;
+
+	if (inflate_idat(state, &chunk, raw, rawlen) == false)
+		return false;
+
+	// Only ancillary chunks may follow, up to the end chunk:
+	while (chunk.type != CHUNK_IEND)
+		if (CHUNK_ANCILLARY(chunk.type) == 0 || chunk_next(state, &chunk) == false)
+			return false;
+
+	state->indexed  = in->indexed && state->color == COLOR_PALETTE;
+	state->channels = state->indexed ? 1 : in->rgba ? 4 : 3;
+
+	out->width    = state->width;
+	out->height   = state->height;
+	out->channels = state->channels;
+
+	if (png_buf_alloc(in, out) == NULL)
+		return false;
+
+	if (state->indexed)
+		memcpy(out->palette, state->palette, PNG_PALETTE_SIZE);
+
+	// Reconstruct the rows in place and convert them to the output:
+	for (uint32_t y = 0; y < state->height; y++) {
+		const uint8_t *prev = raw + rowlen * y - state->stride;
+		uint8_t       *row  = raw + rowlen * y;
+
+		if (unfilter(row + 1, prev, state->stride, state->bpp, row[0]) == false)
+			return false;
+
+		if (convert(state, out->buf + (size_t) y * state->width * out->channels, row + 1) == false)
+			return false;
+	}
+
+	return true;
+}
+
+bool
+png_inflate_load (const struct png_in *in, struct png_out *out)
+{
+	static const uint8_t signature[8] = {
+		0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n',
+	};
+
+	struct state state = {
+		.cur = in->buf + sizeof (signature),
+		.end = in->buf + in->len,
+	};
+
+	// Reset the caller-supplied output pointer.
+	out->buf = NULL;
+
+	if (in->len < sizeof (signature) || memcmp(in->buf, signature, sizeof (signature)))
+		return false;
+
+	if (load(&state, in, out))
+		return true;
+
+	png_buf_free(in, out);
+	return false;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../png.h"
+
+// Backend decoders. Both produce the same 8-bit RGB or RGBA output.
+extern bool png_libpng_load  (const struct png_in *in, struct png_out *out);
+extern bool png_inflate_load (const struct png_in *in, struct png_out *out);
+
+// Allocate and free the output pixel buffer with the user's allocator.
+extern void *png_buf_alloc (const struct png_in *in, struct png_out *out);
+extern void  png_buf_free  (const struct png_in *in, struct png_out *out);
+
+// Expand RGB pixels to RGBA with opaque alpha.
+extern void png_rgb_to_rgba (uint8_t *restrict dst, const uint8_t *restrict src, const size_t pixels);
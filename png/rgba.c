@@ -0,0 +1,32 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "local.h"
+
+typedef uint8_t v16u8 __attribute__((vector_size(16)));
+
+void
+png_rgb_to_rgba (uint8_t *restrict dst, const uint8_t *restrict src, const size_t pixels)
+{
+	// Spread four RGB pixels over four RGBA pixels. Indices from 16 up
+	// select from the second operand, which is all opaque alpha:
+	const v16u8 mask = { 0, 1, 2, 16, 3, 4, 5, 17, 6, 7, 8, 18, 9, 10, 11, 19 };
+	const v16u8 alpha = ~(v16u8) { 0 };
+	size_t i = 0;
+
+	// Each load reads sixteen bytes of which twelve are used, so stop
+	// while there are still at least that many bytes left in the source:
+	for (; i + 6 <= pixels; i += 4, src += 12, dst += 16) {
+		v16u8 v;
+
+		memcpy(&v, src, sizeof (v));
+		v = __builtin_shuffle(v, alpha, mask);
+		memcpy(dst, &v, sizeof (v));
+	}
+
+	for (; i < pixels; i++, src += 3, dst += 4) {
+		memcpy(dst, src, 3);
+		dst[3] = 0xFF;
+	}
+}
@@ -1,3 +1,4 @@
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -8,8 +9,36 @@
 #include "diskcache.h"
 #include "png.h"
 #include "pngloader.h"
+#include "slab.h"
+
+#define TILESIZE	256	// pixels per side
+
+// Pools of fixed-size slots for decoded tiles, one for RGBA tiles and one for
+// indexed tiles with their palette, with the number of slots in both, and the
+// highest number of them in use at once:
+static struct {
+	struct slab  *rgba;
+	struct slab  *indexed;
+	size_t        slots;
+	atomic_size_t peak;
+} slab;
+
+static size_t
+used (void)
+{
+	return slab_used(slab.rgba) + slab_used(slab.indexed);
+}
 
-#define TILESIZE	256	// rgb pixels per side
+// Raise the peak to the number of slots in use now:
+static void
+peak_update (void)
+{
+	const size_t now = used();
+	size_t peak = atomic_load(&slab.peak);
+
+	while (now > peak && !atomic_compare_exchange_weak(&slab.peak, &peak, now))
+		continue;
+}
 
 // Return the contents of a file.
 static void *
@@ -57,24 +86,108 @@ read_pngdata (const struct cache_node *req, size_t *len)
 	return buf;
 }
 
-void *
-pngloader_main (const struct cache_node *req)
+// Let the decoder write directly into a pool slot. Only accept tiles of the
+// expected geometry, so that every slot in a pool has the same size:
+static void *
+slot_alloc (const struct png_out *out)
 {
-	struct png_in  in = { .name = "cache request" };
-	struct png_out out;
+	void *buf;
 
-	if ((in.buf = read_pngdata(req, &in.len)) == NULL)
+	if (out->height != TILESIZE || out->width != TILESIZE)
 		return NULL;
 
-	if (png_load(&in, &out) == false) {
-		free((void *) in.buf);
-		return NULL;
+	switch (out->channels) {
+	case 1:  buf = slab_alloc(slab.indexed); break;
+	case 4:  buf = slab_alloc(slab.rgba);    break;
+	default: return NULL;
 	}
 
+	if (buf != NULL)
+		peak_update();
+
+	return buf;
+}
+
+static void
+slot_free (void *buf)
+{
+	if (slab_contains(slab.indexed, buf))
+		slab_free(slab.indexed, buf);
+	else
+		slab_free(slab.rgba, buf);
+}
+
+bool
+pngloader_main (const struct cache_node *req, struct png_out *out)
+{
+	bool ret;
+	struct png_in in = {
+		.name    = "cache request",
+		.alloc   = slot_alloc,
+		.free    = slot_free,
+		.indexed = true,
+		.rgba    = true,
+	};
+
+	if ((in.buf = read_pngdata(req, &in.len)) == NULL)
+		return false;
+
+	ret = png_load(&in, out);
 	free((void *) in.buf);
-	if (out.height == TILESIZE && out.width == TILESIZE)
-		return out.buf;
+	return ret;
+}
+
+void
+pngloader_free (void *pixels)
+{
+	slot_free(pixels);
+}
+
+void
+pngloader_stats (struct pngloader_stats *stats)
+{
+	*stats = (struct pngloader_stats) {
+		.used  = used(),
+		.peak  = atomic_load(&slab.peak),
+		.slots = slab.slots,
+	};
+}
+
+void
+pngloader_destroy (void)
+{
+	slab_destroy(slab.indexed);
+	slab_destroy(slab.rgba);
+
+	slab.indexed = NULL;
+	slab.rgba    = NULL;
+	slab.slots   = 0;
+}
+
+bool
+pngloader_create (const size_t slots)
+{
+	const struct slab_config rgba = {
+		.slotsize  = TILESIZE * TILESIZE * 4,
+		.slots     = slots,
+		.hugepages = true,
+	};
+
+	const struct slab_config indexed = {
+		.slotsize  = TILESIZE * TILESIZE + PNG_PALETTE_SIZE,
+		.slots     = slots,
+		.hugepages = true,
+	};
+
+	if ((slab.rgba = slab_create(&rgba)) == NULL)
+		return false;
+
+	if ((slab.indexed = slab_create(&indexed)) == NULL) {
+		pngloader_destroy();
+		return false;
+	}
 
-	free(out.buf);
-	return NULL;
+	slab.slots = slots * 2;
+	atomic_store(&slab.peak, 0);
+	return true;
 }
@@ -1,5 +1,29 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "cache.h"
+#include "png.h"
+
+// Load and decode the tile for the request. Paletted tiles are kept indexed.
+// The pixels must be released with pngloader_free().
+extern bool pngloader_main (const struct cache_node *req, struct png_out *out);
+
+// Release the pixels of a decoded tile.
+extern void pngloader_free (void *pixels);
+
+// Slots of the pools of decoded tiles: the number in use now, the highest
+// number in use at once, and the total in both pools.
+struct pngloader_stats {
+	size_t used;
+	size_t peak;
+	size_t slots;
+};
+
+extern void pngloader_stats (struct pngloader_stats *stats);
 
-extern void *pngloader_main (const struct cache_node *req);
+// Create/destroy the pools of decoded tiles, holding at most #slots tiles of
+// each kind.
+extern void pngloader_destroy (void);
+extern bool pngloader_create  (const size_t slots);
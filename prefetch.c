@@ -0,0 +1,98 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "bitmap_cache.h"
+#include "camera.h"
+#include "globe.h"
+#include "matrix.h"
+#include "pan.h"
+#include "prefetch.h"
+#include "tilepicker.h"
+#include "viewport.h"
+#include "zoom.h"
+
+// How far ahead to predict the camera pose, and the minimal time between two
+// predictions, in usec:
+#define PREFETCH_AHEAD		300000
+#define PREFETCH_INTERVAL	50000
+
+static int64_t last;
+
+// Fill in the viewport members used by the tile selection for a predicted
+// cursor position and camera distance. The matrices are composed as in
+// globe_moveto() and camera.c:
+static void
+viewport_predict (struct viewport *vp, const struct camera *cam, const double lat, const double lon, const double distance)
+{
+	double rotate_lat[16], rotate_lon[16], model[16], translate[16], view[16];
+	double cam_pos[4], origin[4] = { 0.0, 0.0, 0.0, 1.0 };
+	const struct viewport *cur = viewport_get();
+
+	vp->width  = cur->width;
+	vp->height = cur->height;
+
+	// Inverse model matrix:
+	mat_rotate(rotate_lon,  0.0, 1.0, 0.0, -lon);
+	mat_rotate(rotate_lat, -1.0, 0.0, 0.0, -fmax(fmin(lat, M_PI_2), -M_PI_2));
+	mat_multiply(model, rotate_lon, rotate_lat);
+
+	// Inverse view matrix:
+	mat_translate(translate, 0.0, 0.0, distance);
+	mat_multiply(view, cam->invert.rotate, cam->invert.tilt);
+	mat_multiply(view, view, translate);
+	mat_multiply(view, cam->invert.radius, view);
+
+	mat_multiply(vp->invert64.modelview, model, view);
+
+	// Find camera position in model space by unprojecting origin:
+	mat_vec64_multiply(cam_pos, vp->invert64.modelview, origin);
+
+	for (int i = 0; i < 3; i++) {
+		vp->cam_pos[i]         = cam_pos[i];
+		vp->cam_pos_lowbits[i] = cam_pos[i] - vp->cam_pos[i];
+	}
+}
+
+static void
+on_tile (const struct tilepicker *tile, const uint32_t coverage, void *arg)
+{
+	(void) coverage;
+	(void) arg;
+
+	bitmap_cache_prefetch(&(struct cache_node) {
+		.x    = tile->x,
+		.y    = tile->y,
+		.zoom = tile->zoom,
+	});
+}
+
+void
+prefetch_on_tick (const int64_t now)
+{
+	const struct camera *cam  = camera_get();
+	const struct globe *globe = globe_get();
+	double lat = globe->lat, lon = globe->lon, distance = cam->distance;
+	struct viewport vp;
+	struct camera pred;
+
+	if (now - last < PREFETCH_INTERVAL)
+		return;
+
+	// Only predict while the camera is moving:
+	const bool pan  = pan_predict(now, PREFETCH_AHEAD, &lat, &lon);
+	const bool zoom = zoom_predict(&distance);
+
+	if (pan == false && zoom == false)
+		return;
+
+	last = now;
+
+	viewport_predict(&vp, cam, lat, lon, distance);
+	pred = *cam;
+	pred.distance = distance;
+
+	// Tiles that are already cached or queued are skipped:
+	bitmap_cache_lock();
+	tilepicker_predict(&vp, &pred, on_tile, NULL);
+	bitmap_cache_unlock();
+}
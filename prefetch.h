@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+// Predict where the camera will be a short time ahead, and start loading the
+// tiles that will be visible there. Call on every timer tick.
+extern void prefetch_on_tick (const int64_t now);
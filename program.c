@@ -1,7 +1,8 @@
+#include "glutil.h"
 #include "program.h"
 
 void
 program_none (void)
 {
-	glUseProgram(0);
+	glutil_program(0);
 }
@@ -33,6 +33,13 @@ struct input {
 	GLint           loc;
 };
 
+enum program_state {
+	PROGRAM_NONE,
+	PROGRAM_SUBMITTED,
+	PROGRAM_READY,
+	PROGRAM_FAILED,
+};
+
 struct program {
 
 	// Pointer to the next program in the linked list.
@@ -43,7 +50,11 @@ struct program {
 	struct shader vertex;
 	GLuint        id;
 	struct input *inputs;
-	bool          created;
+
+	// Lazy programs are not built at startup, but on first use:
+	bool               lazy;
+	bool               cached;
+	enum program_state state;
 };
 
 extern void program_none (void);
@@ -1,6 +1,7 @@
 #include <stdbool.h>
 #include <GL/gl.h>
 
+#include "../glutil.h"
 #include "../inlinebin.h"
 #include "../program.h"
 #include "bkgd.h"
@@ -27,7 +28,7 @@ program_bkgd_loc (const enum LocBkgd index)
 void
 program_bkgd_use (void)
 {
-	glUseProgram(program.id);
+	glutil_program(program.id);
 }
 
 PROGRAM_REGISTER(&program)
@@ -1,22 +1,19 @@
 #include <stdbool.h>
 #include <GL/gl.h>
 
+#include "../glutil.h"
 #include "../inlinebin.h"
 #include "../program.h"
 #include "frustum.h"
 
-enum	{ CAM
-	, MAT_MVP_ORIGIN
-	, MAT_PROJ
+enum	{ MAT_PROJ
 	, VERTEX
 	} ;
 
 static struct input inputs[] =
-	{ [CAM]            = { .name = "cam",            .type = TYPE_UNIFORM }
-	, [MAT_MVP_ORIGIN] = { .name = "mat_mvp_origin", .type = TYPE_UNIFORM }
-	, [MAT_PROJ]       = { .name = "mat_proj",       .type = TYPE_UNIFORM }
-	, [VERTEX]         = { .name = "vertex",         .type = TYPE_ATTRIBUTE }
-	,                    { .name = NULL }
+	{ [MAT_PROJ] = { .name = "mat_proj", .type = TYPE_UNIFORM   }
+	, [VERTEX]   = { .name = "vertex",   .type = TYPE_ATTRIBUTE }
+	,              { .name = NULL }
 	} ;
 
 static struct program program = {
@@ -24,21 +21,29 @@ static struct program program = {
 	.vertex   = { SHADER_FRUSTUM_VERTEX },
 	.fragment = { SHADER_FRUSTUM_FRAGMENT },
 	.inputs   = inputs,
+	.lazy     = true,
 };
 
 GLint
 program_frustum_loc_vertex (void)
 {
+	if (programs_require(&program) == false)
+		return -1;
+
 	return inputs[VERTEX].loc;
 }
 
-void
+bool
 program_frustum_use (struct program_frustum *values)
 {
-	glUseProgram(program.id);
-	glUniform3fv(inputs[CAM].loc, 1, values->cam);
-	glUniformMatrix4fv(inputs[MAT_MVP_ORIGIN].loc, 1, GL_FALSE, values->mat_mvp_origin);
-	glUniformMatrix4fv(inputs[MAT_PROJ].loc,       1, GL_FALSE, values->mat_proj);
+	if (programs_require(&program) == false)
+		return false;
+
+	// The camera and the modelview-projection matrix come from the
+	// viewport block:
+	glutil_program(program.id);
+	glUniformMatrix4fv(inputs[MAT_PROJ].loc, 1, GL_FALSE, values->mat_proj);
+	return true;
 }
 
 PROGRAM_REGISTER(&program)
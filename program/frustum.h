@@ -1,12 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 struct program_frustum {
-	const float *cam;
-	const float *mat_mvp_origin;
 	const float *mat_proj;
 };
 
 extern int32_t program_frustum_loc_vertex (void);
-extern void    program_frustum_use (struct program_frustum *values);
+extern bool    program_frustum_use (struct program_frustum *values);
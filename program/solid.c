@@ -1,6 +1,7 @@
 #include <stdbool.h>
 #include <GL/gl.h>
 
+#include "../glutil.h"
 #include "../inlinebin.h"
 #include "../program.h"
 #include "solid.h"
@@ -22,25 +23,36 @@ static struct program program = {
 	.vertex   = { SHADER_SOLID_VERTEX },
 	.fragment = { SHADER_SOLID_FRAGMENT },
 	.inputs   = inputs,
+	.lazy     = true,
 };
 
 GLint
 program_solid_loc_color (void)
 {
+	if (programs_require(&program) == false)
+		return -1;
+
 	return inputs[COLOR].loc;
 }
 
 GLint
 program_solid_loc_vertex (void)
 {
+	if (programs_require(&program) == false)
+		return -1;
+
 	return inputs[VERTEX].loc;
 }
 
-void
+bool
 program_solid_use (struct program_solid *values)
 {
-	glUseProgram(program.id);
+	if (programs_require(&program) == false)
+		return false;
+
+	glutil_program(program.id);
 	glUniformMatrix4fv(inputs[MATRIX].loc, 1, GL_FALSE, values->matrix);
+	return true;
 }
 
 PROGRAM_REGISTER(&program)
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
+
 struct program_solid {
 	const float *matrix;
 };
 
 GLint program_solid_loc_color (void);
 GLint program_solid_loc_vertex (void);
-void program_solid_use (struct program_solid *);
+bool program_solid_use (struct program_solid *);
@@ -1,9 +1,10 @@
 #pragma once
 
-#include "../cache.h"
-#include "../camera.h"
-#include "../globe.h"
-#include "../viewport.h"
+#include "../texture_cache.h"
 
-extern void program_spherical_set_tile (const struct cache_node *tile, const struct globe_tile *coords);
-extern void program_spherical_use (const struct camera *cam, const struct viewport *vp);
+// Attribute locations of the per-instance tile data:
+extern int program_spherical_loc_tile_tex    (void);
+extern int program_spherical_loc_tile_vertex (void);
+extern int program_spherical_loc_tile_xyz    (void);
+
+extern void program_spherical_use (void);
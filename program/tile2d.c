@@ -1,6 +1,7 @@
 #include <stdbool.h>
 #include <GL/gl.h>
 
+#include "../glutil.h"
 #include "../inlinebin.h"
 #include "../program.h"
 #include "tile2d.h"
@@ -28,7 +29,7 @@ program_tile2d_loc (const enum LocCursor index)
 void
 program_tile2d_use (struct program_tile2d *values)
 {
-	glUseProgram(program.id);
+	glutil_program(program.id);
 	glUniformMatrix4fv(inputs[LOC_TILE2D_MAT_PROJ].loc, 1, GL_FALSE, values->mat_proj);
 }
 
@@ -1,24 +1,25 @@
 #include <stdbool.h>
 #include <GL/gl.h>
 
+#include "../glutil.h"
 #include "../inlinebin.h"
 #include "../program.h"
 #include "tilepicker.h"
 
-enum	{ CAM
-	, MAT_MV_INV
+enum	{ COARSE
 	, VP_ANGLE
 	, VP_HEIGHT
 	, VP_WIDTH
+	, REFINE
 	, VERTEX
 	} ;
 
 static struct input inputs[] =
-	{ [CAM]        = { .name = "cam",        .type = TYPE_UNIFORM   }
-	, [MAT_MV_INV] = { .name = "mat_mv_inv", .type = TYPE_UNIFORM   }
+	{ [COARSE]     = { .name = "coarse",     .type = TYPE_UNIFORM   }
 	, [VP_ANGLE]   = { .name = "vp_angle",   .type = TYPE_UNIFORM   }
 	, [VP_HEIGHT]  = { .name = "vp_height",  .type = TYPE_UNIFORM   }
 	, [VP_WIDTH]   = { .name = "vp_width",   .type = TYPE_UNIFORM   }
+	, [REFINE]     = { .name = "refine",     .type = TYPE_UNIFORM   }
 	, [VERTEX]     = { .name = "vertex",     .type = TYPE_ATTRIBUTE }
 	,                { .name = NULL }
 	} ;
@@ -28,23 +29,33 @@ static struct program program = {
 	.vertex   = { SHADER_TILEPICKER_VERTEX   },
 	.fragment = { SHADER_TILEPICKER_FRAGMENT },
 	.inputs   = inputs,
+	.lazy     = true,
 };
 
 int
 program_tilepicker_loc_vertex (void)
 {
+	if (programs_require(&program) == false)
+		return -1;
+
 	return inputs[VERTEX].loc;
 }
 
-void
+bool
 program_tilepicker_use (const struct program_tilepicker *values)
 {
-	glUseProgram(program.id);
-	glUniform3fv(inputs[CAM].loc, 1, values->cam);
-	glUniformMatrix4fv(inputs[MAT_MV_INV].loc, 1, GL_FALSE, values->mat_mv_inv);
+	if (programs_require(&program) == false)
+		return false;
+
+	// The camera and the inverse modelview matrix come from the viewport
+	// block. The angle and the size differ from the window's:
+	glutil_program(program.id);
 	glUniform1f(inputs[VP_ANGLE].loc,  values->vp_angle);
 	glUniform1f(inputs[VP_HEIGHT].loc, values->vp_height);
 	glUniform1f(inputs[VP_WIDTH].loc,  values->vp_width);
+	glUniform1i(inputs[REFINE].loc,    values->refine);
+	glUniform1i(inputs[COARSE].loc,    0);
+	return true;
 }
 
 PROGRAM_REGISTER(&program)
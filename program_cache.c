@@ -0,0 +1,199 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <GL/gl.h>
+
+#include "inlinebin.h"
+#include "program_cache.h"
+#include "util.h"
+
+// Header in front of the program binary in a cache file:
+struct header {
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+// 64-bit FNV-1a hash:
+static uint64_t
+hash (uint64_t h, const void *buf, const size_t len)
+{
+	const uint8_t *p = buf;
+
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ p[i]) * 0x100000001B3u;
+
+	return h;
+}
+
+// The key covers the shader sources and the driver that compiled them. A
+// binary from another driver version would be rejected anyway, but
+// comparing the key up front avoids handing it over:
+static uint64_t
+key (const struct program *program)
+{
+	static const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	const enum Inlinebin src[] = { program->vertex.src, program->fragment.src };
+	uint64_t h = 0xCBF29CE484222325u;
+
+	FOREACH (strings, s) {
+		const char *str = (const char *) glGetString(*s);
+
+		if (str != NULL)
+			h = hash(h, str, strlen(str) + 1);
+	}
+
+	FOREACH (src, s) {
+		const uint8_t *buf;
+		size_t len;
+
+		if (*s == INLINEBIN_NONE)
+			continue;
+
+		inlinebin_get(*s, &buf, &len);
+		h = hash(h, buf, len);
+	}
+
+	return h;
+}
+
+// Check whether the driver supports any binary format at all:
+static bool
+supported (void)
+{
+	GLint formats = 0;
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+// Return a malloc()'ed string containing the filename of the cached program,
+// to be freed by the caller with free(), or NULL on error. Creates the cache
+// directory if needed:
+static char *
+get_filename (const struct program *program)
+{
+	const char *base = getenv("XDG_CACHE_HOME");
+	char *dir, *name;
+	int ret;
+
+	if (base != NULL && *base != '\0')
+		ret = asprintf(&dir, "%s/osymandias", base);
+	else if ((base = getenv("HOME")) != NULL)
+		ret = asprintf(&dir, "%s/.cache/osymandias", base);
+	else
+		return NULL;
+
+	if (ret < 0)
+		return NULL;
+
+	// Create the directory and its parent, ignoring existing ones:
+	*strrchr(dir, '/') = '\0';
+	mkdir(dir, S_IRWXU);
+	dir[strlen(dir)] = '/';
+	mkdir(dir, S_IRWXU);
+
+	ret = asprintf(&name, "%s/program-%s.bin", dir, program->name);
+	free(dir);
+
+	return ret < 0 ? NULL : name;
+}
+
+bool
+program_cache_load (struct program *program)
+{
+	struct header header;
+	bool ret = false;
+	char *filename;
+	void *buf;
+	FILE *f;
+
+	if (supported() == false)
+		return false;
+
+	if ((filename = get_filename(program)) == NULL)
+		return false;
+
+	if ((f = fopen(filename, "rb")) == NULL)
+		goto err0;
+
+	if (fread(&header, sizeof (header), 1, f) != 1)
+		goto err1;
+
+	// Compare the key before reading the binary:
+	if (header.key != key(program))
+		goto err1;
+
+	if ((buf = malloc(header.length)) == NULL)
+		goto err1;
+
+	if (fread(buf, header.length, 1, f) != 1)
+		goto err2;
+
+	// The driver can still reject the binary, for instance after an
+	// update that kept the version string:
+	GLint status;
+
+	glProgramBinary(program->id, header.format, buf, header.length);
+	glGetProgramiv(program->id, GL_LINK_STATUS, &status);
+	ret = (status != GL_FALSE);
+
+err2:	free(buf);
+err1:	fclose(f);
+err0:	free(filename);
+	return ret;
+}
+
+void
+program_cache_save (const struct program *program)
+{
+	struct header header = { .key = key(program) };
+	char *filename, *tmpname;
+	GLint length = 0;
+	GLenum format;
+	void *buf;
+	FILE *f;
+
+	if (supported() == false)
+		return;
+
+	glGetProgramiv(program->id, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	if ((buf = malloc(length)) == NULL)
+		return;
+
+	glGetProgramBinary(program->id, length, &length, &format, buf);
+
+	header.format = format;
+	header.length = length;
+
+	if ((filename = get_filename(program)) == NULL)
+		goto err0;
+
+	// Write to a temporary file and rename it into place, so that other
+	// processes never see a partial file:
+	if (asprintf(&tmpname, "%s.%d", filename, (int) getpid()) < 0)
+		goto err1;
+
+	if ((f = fopen(tmpname, "wb")) == NULL)
+		goto err2;
+
+	const bool ok = fwrite(&header, sizeof (header), 1, f) == 1
+	             && fwrite(buf, length, 1, f) == 1;
+
+	if (fclose(f) == 0 && ok)
+		rename(tmpname, filename);
+	else
+		unlink(tmpname);
+
+err2:	free(tmpname);
+err1:	free(filename);
+err0:	free(buf);
+}
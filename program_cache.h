@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "program.h"
+
+// Linked program binaries are cached on disk, keyed by the shader sources and
+// the driver. Load a program from the cache, returns false on a miss:
+extern bool program_cache_load (struct program *program);
+
+// Store a freshly linked program in the cache. The program must have been
+// linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set:
+extern void program_cache_save (const struct program *program);
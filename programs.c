@@ -1,7 +1,10 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "glutil.h"
 #include "program.h"
+#include "program_cache.h"
 #include "programs.h"
 
 // Pointer to the first program in the linked list.
@@ -12,7 +15,6 @@ struct shadermeta {
 	struct shader	*shader;
 	const char	*progname;
 	const char	*typename;
-	GLenum		 type;
 };
 
 static bool
@@ -58,163 +60,187 @@ link_success (struct program *program)
 	return false;
 }
 
-static bool
-shader_compile (struct shadermeta *meta)
+// Start compiling a shader and attach it. The status is checked later, so
+// that the driver can compile several shaders at once:
+static void
+shader_submit (struct program *program, struct shader *shader, const GLenum type)
 {
-	struct shader *shader = meta->shader;
+	if (shader->src == INLINEBIN_NONE)
+		return;
 
 	inlinebin_get(shader->src, &shader->buf, &shader->len);
 
 	const GLchar *const *buf = (const GLchar *const *) &shader->buf;
 	const GLint         *len = (const GLint *)         &shader->len;
 
-	shader->id = glCreateShader(meta->type);
+	shader->id = glCreateShader(type);
 	glShaderSource(shader->id, 1, buf, len);
 	glCompileShader(shader->id);
-
-	if (compile_success(meta))
-		return true;
-
-	glDeleteShader(shader->id);
-	return false;
+	glAttachShader(program->id, shader->id);
 }
 
 static bool
-shader_fragment_create (struct program *program)
+shader_finish (struct program *program, struct shader *shader, const char *typename)
 {
-	if (program->fragment.src == INLINEBIN_NONE)
+	if (shader->src == INLINEBIN_NONE)
 		return true;
 
 	struct shadermeta meta = {
-		.shader		= &program->fragment,
+		.shader		= shader,
 		.progname	= program->name,
-		.typename	= "fragment",
-		.type		= GL_FRAGMENT_SHADER
+		.typename	= typename,
 	};
 
-	if (!shader_compile(&meta))
-		return false;
+	const bool ret = compile_success(&meta);
 
-	glAttachShader(program->id, meta.shader->id);
-	return true;
+	glDetachShader(program->id, shader->id);
+	glDeleteShader(shader->id);
+	return ret;
 }
 
 static bool
-shader_vertex_create (struct program *program)
+input_link (struct program *program, struct input *i)
 {
-	if (program->vertex.src == INLINEBIN_NONE)
-		return true;
+	const char *type = "";
 
-	struct shadermeta meta = {
-		.shader		= &program->vertex,
-		.progname	= program->name,
-		.typename	= "vertex",
-		.type		= GL_VERTEX_SHADER
-	};
+	switch (i->type)
+	{
+	case TYPE_UNIFORM:
+		type = "uniform";
+		i->loc = glGetUniformLocation(program->id, i->name);
+		break;
 
-	if (!shader_compile(&meta))
-		return false;
+	case TYPE_ATTRIBUTE:
+		type = "attribute";
+		i->loc = glGetAttribLocation(program->id, i->name);
+		break;
+	}
 
-	glAttachShader(program->id, meta.shader->id);
-	return true;
+	if (i->loc >= 0)
+		return true;
+
+	fprintf(stderr, "%s: could not link %s '%s'\n", program->name, type, i->name);
+	return false;
 }
 
+// Connect the viewport uniform block, if the program uses it:
 static void
-shader_fragment_destroy (struct program *program)
+block_bind (struct program *program)
 {
-	if (program->fragment.src == INLINEBIN_NONE)
-		return;
+	const GLuint index = glGetUniformBlockIndex(program->id, "viewport");
 
-	glDetachShader(program->id, program->fragment.id);
-	glDeleteShader(program->fragment.id);
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program->id, index, PROGRAMS_BLOCK_VIEWPORT);
 }
 
+// Create the program and start building it, without waiting for the result:
 static void
-shader_vertex_destroy (struct program *program)
+program_submit (struct program *program)
 {
-	if (program->vertex.src == INLINEBIN_NONE)
+	program->id    = glCreateProgram();
+	program->state = PROGRAM_SUBMITTED;
+
+	// A cached binary needs no compilation:
+	if ((program->cached = program_cache_load(program)))
 		return;
 
-	glDetachShader(program->id, program->vertex.id);
-	glDeleteShader(program->vertex.id);
+	glProgramParameteri(program->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	shader_submit(program, &program->vertex,   GL_VERTEX_SHADER);
+	shader_submit(program, &program->fragment, GL_FRAGMENT_SHADER);
+	glLinkProgram(program->id);
 }
 
+// Wait for the program to be built, and look up its inputs:
 static bool
-program_link (struct program *program)
+program_finish (struct program *program)
 {
-	bool ret = false;
+	program->state = PROGRAM_FAILED;
 
-	if (!shader_vertex_create(program))
-		return false;
+	if (!program->cached) {
+		bool ok = shader_finish(program, &program->vertex, "vertex");
 
-	if (!shader_fragment_create(program))
-		goto err;
+		ok &= shader_finish(program, &program->fragment, "fragment");
 
-	glLinkProgram(program->id);
-	ret = true;
+		if (!ok || !link_success(program))
+			return false;
 
-	shader_fragment_destroy(program);
-err:	shader_vertex_destroy(program);
-	return ret;
+		program_cache_save(program);
+	}
+
+	block_bind(program);
+
+	for (struct input *input = program->inputs; input->name; input++)
+		if (!input_link(program, input))
+			return false;
+
+	program->state = PROGRAM_READY;
+	return true;
 }
 
+// Check for an extension of the current context:
 static bool
-input_link (struct program *program, struct input *i)
+has_extension (const char *name)
 {
-	const char *type = "";
+	GLint num;
 
-	switch (i->type)
-	{
-	case TYPE_UNIFORM:
-		type = "uniform";
-		i->loc = glGetUniformLocation(program->id, i->name);
-		break;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num);
 
-	case TYPE_ATTRIBUTE:
-		type = "attribute";
-		i->loc = glGetAttribLocation(program->id, i->name);
-		break;
-	}
+	for (GLint i = 0; i < num; i++)
+		if (strcmp((const char *) glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
 
-	if (i->loc >= 0)
-		return true;
-
-	fprintf(stderr, "%s: could not link %s '%s'\n", program->name, type, i->name);
 	return false;
 }
 
-static bool
-program_create (struct program *program)
+bool
+programs_require (struct program *program)
 {
-	program->id = glCreateProgram();
-	program->created = true;
+	switch (program->state) {
+	case PROGRAM_NONE:
+		program_submit(program);
+		return program_finish(program);
 
-	if (!program_link(program))
-		return false;
-
-	if (!link_success(program))
-		return false;
+	case PROGRAM_SUBMITTED:
+		return program_finish(program);
 
-	for (struct input *input = program->inputs; input->name; input++)
-		if (!input_link(program, input))
-			return false;
+	case PROGRAM_READY:
+		return true;
 
-	return true;
+	default:
+		return false;
+	}
 }
 
 void
 programs_destroy (void)
 {
 	for (struct program *p = program_list; p; p = p->next)
-		if (p->created)
+		if (p->state != PROGRAM_NONE) {
 			glDeleteProgram(p->id);
+			p->state = PROGRAM_NONE;
+		}
+
+	// New programs can reuse the names, so forget the current one:
+	glutil_state_reset();
 }
 
 bool
 programs_init (void)
 {
+	// Let the driver compile on its own threads, if it can:
+	if (has_extension("GL_KHR_parallel_shader_compile"))
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+
+	// Submit all programs needed for the first frame before the first
+	// status query, so that drivers can build them concurrently. The
+	// other programs are built on first use:
+	for (struct program *p = program_list; p; p = p->next)
+		if (!p->lazy)
+			program_submit(p);
+
 	for (struct program *p = program_list; p; p = p->next)
-		if (!program_create(p)) {
+		if (!p->lazy && !program_finish(p)) {
 			programs_destroy();
 			return false;
 		}
@@ -5,6 +5,13 @@
 // Forward declaration to avoid an include loop.
 struct program;
 
+// Binding point of the uniform block with the viewport state, which every
+// program that declares it shares:
+#define PROGRAMS_BLOCK_VIEWPORT	0
+
 extern bool programs_init    (void);
 extern void programs_destroy (void);
 extern void programs_link    (struct program *program);
+
+// Build a program now if it was not built at startup:
+extern bool programs_require (struct program *program);
@@ -0,0 +1,6 @@
+#pragma once
+
+// Request a repaint of the viewport. This function can be called from any
+// thread. The GTK frontend paints on the next tick of its frame clock, the
+// headless renderer before it saves the image.
+extern void framerate_repaint (void);
@@ -1,6 +1,16 @@
 #version 130
-
-uniform vec3 cam;
+#extension GL_ARB_uniform_buffer_object : require
+
+// Viewport state shared by all programs:
+layout(std140) uniform viewport {
+	mat4  mat_mvp_origin;
+	mat4  mat_mv_inv;
+	vec3  cam;
+	float view_angle;	// Horizontal viewing angle in radians
+	vec3  cam_lowbits;
+	float view_width;	// Viewport width in pixels
+	float view_height;	// Viewport height in pixels
+};
 
 noperspective in vec3 p;
 smooth        in float frag_look_angle;
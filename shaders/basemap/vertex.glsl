@@ -1,10 +1,16 @@
 #version 130
-
-uniform mat4  mat_mv_inv;
-uniform float vp_angle;		// Horizontal viewing angle in radians
-uniform float vp_height;	// Viewport height in pixels
-uniform float vp_width;		// Viewport width in pixels
-uniform vec3  cam;
+#extension GL_ARB_uniform_buffer_object : require
+
+// Viewport state shared by all programs:
+layout(std140) uniform viewport {
+	mat4  mat_mvp_origin;
+	mat4  mat_mv_inv;
+	vec3  cam;
+	float view_angle;	// Horizontal viewing angle in radians
+	vec3  cam_lowbits;
+	float view_width;	// Viewport width in pixels
+	float view_height;	// Viewport height in pixels
+};
 
 in vec2 vertex;
 
@@ -18,14 +24,14 @@ void main (void)
 	gl_Position = vec4(vertex, 0.0, 1.0);
 
 	// Half of the total horizontal view angle, the deviation from center:
-	float alpha = vp_angle / 2.0;
+	float alpha = view_angle / 2.0;
 
 	// Use trigonometry to place the vertex point in world space. The
 	// camera is a point at the start of the frustum, while p is a ray
 	// (relative to the camera) that points to the end of the frustum.
 	// After per-fragment interpolation, they can be thought of as the
 	// origin and direction of a ray through the fragment into model space.
-	vec3 vpoint = vec3(vertex * sin(alpha) * vec2(1.0, vp_height / vp_width), -cos(alpha));
+	vec3 vpoint = vec3(vertex * sin(alpha) * vec2(1.0, view_height / view_width), -cos(alpha));
 	p = (mat_mv_inv * vec4(vpoint, 1.0)).xyz - cam;
 
 	// Calculate the horizontal angle between the camera's lookat vector
@@ -33,5 +39,5 @@ void main (void)
 	frag_look_angle = alpha * vertex.x;
 
 	// Calculate the angle of the arc swept by one window pixel:
-	frag_arc_angle = vp_angle / vp_width;
+	frag_arc_angle = view_angle / view_width;
 }
@@ -1,7 +1,16 @@
 #version 130
+#extension GL_ARB_uniform_buffer_object : require
 
-uniform mat4 mat_mvp_origin;
-uniform vec3 cam;
+// Viewport state shared by all programs:
+layout(std140) uniform viewport {
+	mat4  mat_mvp_origin;
+	mat4  mat_mv_inv;
+	vec3  cam;
+	float view_angle;	// Horizontal viewing angle in radians
+	vec3  cam_lowbits;
+	float view_width;	// Viewport width in pixels
+	float view_height;	// Viewport height in pixels
+};
 
 smooth in vec4 fpos;
 
@@ -1,10 +1,26 @@
 #version 130
-
-uniform sampler2D tex;
-uniform int       tile_x;
-uniform int       tile_y;
-uniform int       tile_zoom;
-uniform vec3      cam;
+#extension GL_ARB_uniform_buffer_object : require
+
+// Viewport state shared by all programs:
+layout(std140) uniform viewport {
+	mat4  mat_mvp_origin;
+	mat4  mat_mv_inv;
+	vec3  cam;
+	float view_angle;	// Horizontal viewing angle in radians
+	vec3  cam_lowbits;
+	float view_width;	// Viewport width in pixels
+	float view_height;	// Viewport height in pixels
+};
+
+uniform sampler2DArray tex;
+uniform sampler2DArray indices;
+uniform sampler2D palette;
+
+flat in int   tile_x;
+flat in int   tile_y;
+flat in int   tile_zoom;
+flat in int   tile_layer;
+flat in int   tile_indexed;
 
 flat in vec3  tile_origin;
 flat in vec3  tile_xaxis;
@@ -128,6 +144,19 @@ uvec4 sphere_to_texture_hizoom (out vec4 tx, out vec4 ty)
 		* uvec4(lessThan        (ty, vec4(1.0))));
 }
 
+// Sample the tile from its layer in the texture arrays. Indexed tiles store
+// the palette index in the red channel, normalized to 0..1, which is resolved
+// to a color from the tile's row in the palette texture.
+vec4 texel (in vec2 uv)
+{
+	if (tile_indexed == 0)
+		return texture(tex, vec3(uv, tile_layer));
+
+	float index = texture(indices, vec3(uv, tile_layer)).r;
+
+	return texelFetch(palette, ivec2(int(index * 255.0 + 0.5), tile_layer), 0);
+}
+
 void main (void)
 {
 	float nsamples;
@@ -144,10 +173,10 @@ void main (void)
 
 	// Texture lookup:
 	mat4x4 tsamples = mat4x4(
-		texture(tex, vec2(tx[0], ty[0])),
-		texture(tex, vec2(tx[1], ty[1])),
-		texture(tex, vec2(tx[2], ty[2])),
-		texture(tex, vec2(tx[3], ty[3])));
+		texel(vec2(tx[0], ty[0])),
+		texel(vec2(tx[1], ty[1])),
+		texel(vec2(tx[2], ty[2])),
+		texel(vec2(tx[3], ty[3])));
 
 	// Square the values:
 	tsamples = matrixCompMult(tsamples, tsamples);
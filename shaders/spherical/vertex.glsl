@@ -1,13 +1,29 @@
 #version 130
+#extension GL_ARB_uniform_buffer_object : require
 
-uniform mat4  mat_mvp_origin;
-uniform mat4  mat_mv_inv;
-uniform int   tile_zoom;
-uniform vec3  cam;
-uniform vec3  cam_lowbits;
-uniform vec3  vertex[4];
-uniform float vp_angle;
-uniform float vp_width;
+// Viewport state shared by all programs:
+layout(std140) uniform viewport {
+	mat4  mat_mvp_origin;
+	mat4  mat_mv_inv;
+	vec3  cam;
+	float view_angle;	// Horizontal viewing angle in radians
+	vec3  cam_lowbits;
+	float view_width;	// Viewport width in pixels
+	float view_height;	// Viewport height in pixels
+};
+
+// Per-instance tile attributes: tile coordinates and zoom, the tile's four
+// corners on the sphere, and its layer in the tile store with a flag for
+// indexed tiles:
+in uvec3  tile_xyz;
+in mat4x3 tile_vertex;
+in uvec2  tile_tex;
+
+flat out int   tile_x;
+flat out int   tile_y;
+flat out int   tile_zoom;
+flat out int   tile_layer;
+flat out int   tile_indexed;
 
 flat out vec3  tile_origin;
 flat out vec3  tile_xaxis;
@@ -21,6 +37,16 @@ smooth out mat4x3 rays;
 
 void main (void)
 {
+	// Pass the tile attributes on to the fragment shader:
+	tile_x       = int(tile_xyz.x);
+	tile_y       = int(tile_xyz.y);
+	tile_zoom    = int(tile_xyz.z);
+	tile_layer   = int(tile_tex.x);
+	tile_indexed = int(tile_tex.y);
+
+	// The corners are the columns of the matrix:
+	mat4x3 vertex = tile_vertex;
+
 	// Find the vertex position relative to the camera. The result is a
 	// direction vector with the camera as the origin, or rather a ray:
 	vec3 p = vertex[gl_VertexID] - cam - cam_lowbits;
@@ -34,7 +60,7 @@ void main (void)
 	gl_Position.z *= gl_Position.w;
 
 	// Angle in radians of the arc swept by one pixel:
-	float arc = vp_angle / vp_width;
+	float arc = view_angle / view_width;
 
 	// Cast four subpixel rays at slight offsets to p for antialiasing:
 	//
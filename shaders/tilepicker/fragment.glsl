@@ -1,6 +1,20 @@
 #version 130
-
-uniform vec3 cam;
+#extension GL_ARB_uniform_buffer_object : require
+
+// Viewport state shared by all programs:
+layout(std140) uniform viewport {
+	mat4  mat_mvp_origin;
+	mat4  mat_mv_inv;
+	vec3  cam;
+	float view_angle;	// Horizontal viewing angle in radians
+	vec3  cam_lowbits;
+	float view_width;	// Viewport width in pixels
+	float view_height;	// Viewport height in pixels
+};
+
+// In the refinement pass, the coarse image and the subdivision of its cells:
+uniform usampler2D coarse;
+uniform int        refine;
 
 noperspective in vec3 p;
 smooth        in float frag_look_angle;
@@ -105,11 +119,33 @@ bool sphere_intersect (in vec3 nray, out vec3 hit)
 	return true;
 }
 
+// Check whether a cell of the coarse image has the same zoom level and
+// validity as its direct neighbours. Only other cells need refinement:
+bool cell_stable (void)
+{
+	ivec2 size = textureSize(coarse, 0);
+	ivec2 cell = ivec2(gl_FragCoord.xy) / refine;
+	uvec2 zoom = texelFetch(coarse, cell, 0).zw;
+
+	if (texelFetch(coarse, clamp(cell + ivec2(-1,  0), ivec2(0), size - 1), 0).zw != zoom) return false;
+	if (texelFetch(coarse, clamp(cell + ivec2( 1,  0), ivec2(0), size - 1), 0).zw != zoom) return false;
+	if (texelFetch(coarse, clamp(cell + ivec2( 0, -1), ivec2(0), size - 1), 0).zw != zoom) return false;
+	if (texelFetch(coarse, clamp(cell + ivec2( 0,  1), ivec2(0), size - 1), 0).zw != zoom) return false;
+
+	return true;
+}
+
 void main (void)
 {
 	vec3 hit;
 	vec2 tile;
 
+	// In the refinement pass, skip the cells that need no refinement:
+	if (refine > 0 && cell_stable()) {
+		fragcolor = uvec4(0);
+		return;
+	}
+
 	// Intersect the ray p from the camera with the unit sphere:
 	if (sphere_intersect(normalize(p), hit) == false) {
 		fragcolor = uvec4(0);
@@ -1,10 +1,20 @@
 #version 130
+#extension GL_ARB_uniform_buffer_object : require
+
+// Viewport state shared by all programs:
+layout(std140) uniform viewport {
+	mat4  mat_mvp_origin;
+	mat4  mat_mv_inv;
+	vec3  cam;
+	float view_angle;	// Horizontal viewing angle in radians
+	vec3  cam_lowbits;
+	float view_width;	// Viewport width in pixels
+	float view_height;	// Viewport height in pixels
+};
 
-uniform mat4  mat_mv_inv;
 uniform float vp_angle;		// Horizontal viewing angle in radians
 uniform float vp_height;	// Viewport height in pixels
 uniform float vp_width;		// Viewport width in pixels
-uniform vec3  cam;
 
 in vec2 vertex;
 
@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+#include "slab.h"
+
+// Size of a huge page, used for rounding the arena size:
+#define HUGEPAGE_SIZE	(2 * 1024 * 1024)
+
+// Marker for the end of the free list:
+#define SLOT_NONE	UINT32_MAX
+
+struct slab {
+
+	// The arena from which slots are carved.
+	uint8_t *arena;
+
+	// Size of the arena in bytes, as passed to mmap().
+	size_t arenasize;
+
+	// Free list links, one per slot: the index of the next free slot.
+	_Atomic uint32_t *next;
+
+	// Head of the free list. The low 32 bits contain the index of the
+	// first free slot, the high 32 bits contain a counter which is bumped
+	// on every update to prevent the ABA problem.
+	_Atomic uint64_t head;
+
+	// Number of slots in use.
+	atomic_size_t used;
+
+	struct slab_config config;
+};
+
+static inline uint64_t
+head_pack (const uint64_t tag, const uint32_t index)
+{
+	return (tag << 32) | index;
+}
+
+static inline uint32_t
+head_index (const uint64_t head)
+{
+	return head & UINT32_MAX;
+}
+
+static inline uint64_t
+head_tag (const uint64_t head)
+{
+	return head >> 32;
+}
+
+void *
+slab_alloc (struct slab *s)
+{
+	uint64_t head = atomic_load(&s->head), next;
+	uint32_t index;
+
+	// Pop the first slot off the free list. The link can be stale if
+	// another thread got there first, but then the tag will have changed
+	// and the exchange will fail:
+	do {
+		if ((index = head_index(head)) == SLOT_NONE)
+			return NULL;
+
+		next = head_pack(head_tag(head) + 1,
+			atomic_load_explicit(&s->next[index], memory_order_relaxed));
+
+	} while (!atomic_compare_exchange_weak(&s->head, &head, next));
+
+	atomic_fetch_add(&s->used, 1);
+	return s->arena + (size_t) index * s->config.slotsize;
+}
+
+void
+slab_free (struct slab *s, void *slot)
+{
+	if (slot == NULL)
+		return;
+
+	const uint32_t index = ((uint8_t *) slot - s->arena) / s->config.slotsize;
+	uint64_t head = atomic_load(&s->head), next;
+
+	// Push the slot onto the front of the free list:
+	do {
+		atomic_store_explicit(&s->next[index], head_index(head), memory_order_relaxed);
+		next = head_pack(head_tag(head) + 1, index);
+
+	} while (!atomic_compare_exchange_weak(&s->head, &head, next));
+
+	atomic_fetch_sub(&s->used, 1);
+}
+
+bool
+slab_contains (const struct slab *s, const void *ptr)
+{
+	if (s == NULL || ptr == NULL)
+		return false;
+
+	const uint8_t *p = ptr;
+
+	return p >= s->arena && p < s->arena + s->config.slots * s->config.slotsize;
+}
+
+size_t
+slab_used (const struct slab *s)
+{
+	return s == NULL ? 0 : atomic_load(&s->used);
+}
+
+// Map the arena, using huge pages if requested and available.
+static bool
+arena_map (struct slab *s)
+{
+	const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+	s->arenasize = s->config.slots * s->config.slotsize;
+
+	if (s->config.hugepages) {
+		const size_t size = (s->arenasize + HUGEPAGE_SIZE - 1) & ~((size_t) HUGEPAGE_SIZE - 1);
+
+		// First try explicit huge pages from the reserved pool. Don't
+		// pass MAP_NORESERVE here, so that the mapping fails up front
+		// instead of faulting later if the pool is too small:
+		s->arena = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		if (s->arena != MAP_FAILED) {
+			s->arenasize = size;
+			return true;
+		}
+	}
+
+	if ((s->arena = mmap(NULL, s->arenasize, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, -1, 0)) == MAP_FAILED)
+		return false;
+
+	// Else fall back to transparent huge pages, if the kernel allows:
+	if (s->config.hugepages)
+		madvise(s->arena, s->arenasize, MADV_HUGEPAGE);
+
+	return true;
+}
+
+void
+slab_destroy (struct slab *s)
+{
+	if (s == NULL)
+		return;
+
+	munmap(s->arena, s->arenasize);
+	free(s->next);
+	free(s);
+}
+
+struct slab *
+slab_create (const struct slab_config *config)
+{
+	struct slab *s;
+
+	if (config == NULL || config->slotsize == 0)
+		return NULL;
+
+	if (config->slots == 0 || config->slots >= SLOT_NONE)
+		return NULL;
+
+	if ((s = calloc(1, sizeof (*s))) == NULL)
+		return NULL;
+
+	s->config = *config;
+
+	if ((s->next = calloc(config->slots, sizeof (*s->next))) == NULL) {
+		free(s);
+		return NULL;
+	}
+
+	if (arena_map(s) == false) {
+		free(s->next);
+		free(s);
+		return NULL;
+	}
+
+	// Chain all slots together into the initial free list:
+	for (uint32_t i = 0; i < config->slots; i++)
+		atomic_init(&s->next[i], i + 1 < config->slots ? i + 1 : SLOT_NONE);
+
+	atomic_init(&s->head, head_pack(0, 0));
+	atomic_init(&s->used, 0);
+	return s;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Opaque slab allocator state structure.
+struct slab;
+
+// Slab allocator config structure.
+struct slab_config {
+
+	// Size of one slot in bytes.
+	size_t slotsize;
+
+	// Total number of slots in the arena.
+	size_t slots;
+
+	// Whether to try to back the arena with huge pages.
+	bool hugepages;
+};
+
+// Take a free slot from the arena. Returns NULL if all slots are in use. Safe
+// to call concurrently from multiple threads.
+extern void *slab_alloc (struct slab *s);
+
+// Return a slot to the arena. Safe to call concurrently from multiple threads.
+extern void slab_free (struct slab *s, void *slot);
+
+// Check whether a pointer belongs to a slot in the arena.
+extern bool slab_contains (const struct slab *s, const void *ptr);
+
+// Get the number of slots currently in use.
+extern size_t slab_used (const struct slab *s);
+
+// Slab creation/destruction.
+extern void slab_destroy (struct slab *s);
+extern struct slab *slab_create (const struct slab_config *config);
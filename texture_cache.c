@@ -1,56 +1,391 @@
+#include <stdlib.h>
+#include <pthread.h>
+
 #include <GL/gl.h>
 
+#include "glutil.h"
 #include "texture_cache.h"
+#include "texture_stream.h"
+#include "thread.h"
+
+#define TILESIZE	256
+
+// Layers per array that loader threads can hold before their textures are
+// adopted, once loader uploads are enabled:
+#define LOADER_LAYERS	16
+
+// Video memory used by one layer of each array. An indexed layer includes its
+// row in the palette texture:
+#define LAYER_SIZE_RGBA		(TILESIZE * TILESIZE * 4)
+#define LAYER_SIZE_INDEXED	(TILESIZE * TILESIZE + 256 * 4)
 
-#define CACHE_CAPACITY	200
+// Share of the video memory for indexed tiles, in percent:
+#define INDEXED_SHARE	50
 
-static struct cache *cache = NULL;
+// A texture array with one layer per cached tile, and the cache of the tiles
+// in it. Layers are recycled through a free list instead of creating and
+// deleting a texture per tile:
+struct array {
+	GLuint        id;
+	uint32_t      layers;
+	uint32_t     *free;
+	uint32_t      nfree;
+	uint32_t      loading;
+	struct cache *cache;
+};
+
+// The tile store: immutable texture arrays for RGBA and for indexed tiles,
+// each with its own layers and cache, so that an indexed tile takes no RGBA
+// memory. Loader threads take layers too, so the free lists have a lock:
+static struct {
+	struct array    rgba;
+	struct array    indexed;
+	GLuint          palette;
+	uint32_t        loaders;
+	pthread_mutex_t lock;
+} store = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static inline struct array *
+array_of (const bool indexed)
+{
+	return indexed ? &store.indexed : &store.rgba;
+}
+
+// Take a layer from the free list of an array. Call with the lock held:
+static bool
+layer_take (struct array *a, uint32_t *layer)
+{
+	if (a->free == NULL || a->nfree == 0)
+		return false;
+
+	*layer = a->free[--a->nfree];
+	return true;
+}
+
+static void
+layer_free (struct array *a, const uint32_t layer)
+{
+	thread_mutex_lock(&store.lock);
+	a->free[a->nfree++] = layer;
+	thread_mutex_unlock(&store.lock);
+}
 
 static void
 on_destroy (void *data)
 {
-	struct texture_cache *tex = data;
+	const struct texture_cache *tex = data;
 
-	glDeleteTextures(1, &tex->id);
+	if (tex->fence != NULL)
+		glDeleteSync(tex->fence);
+
+	layer_free(array_of(tex->indexed), tex->layer);
 }
 
 const struct texture_cache *
 texture_cache_search (const struct cache_node *in, struct cache_node *out)
 {
-	return cache_search(cache, in, out);
+	struct texture_cache *tex, *idx;
+	struct cache_node out_idx;
+
+	// Take the closest tile from either array:
+	tex = cache_search(store.rgba.cache, in, out);
+	idx = cache_search(store.indexed.cache, in, &out_idx);
+
+	if (idx != NULL && (tex == NULL || out_idx.zoom > out->zoom)) {
+		tex  = idx;
+		*out = out_idx;
+	}
+
+	if (tex == NULL)
+		return NULL;
+
+	// Let the GPU wait for the upload by the loader thread before the
+	// texture is first drawn. This does not block the render thread:
+	if (tex->fence != NULL) {
+		glWaitSync(tex->fence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(tex->fence);
+		tex->fence = NULL;
+	}
+
+	return tex;
 }
 
 const struct texture_cache *
 texture_cache_insert (const struct cache_node *loc, const struct bitmap_cache *bitmap)
 {
+	// Don't stall the frame if all upload slots are busy. The caller
+	// draws an ancestor tile instead and retries on a later frame:
+	if (texture_stream_ready() == false)
+		return NULL;
+
+	const bool indexed = bitmap->palette != NULL;
+	struct array *a = array_of(indexed);
+	uint32_t layer;
+	bool ok;
+
+	// Every array has one more layer than its cache and the loader
+	// threads together can hold, so there should always be a free layer
+	// before the insert evicts an entry:
+	thread_mutex_lock(&store.lock);
+	ok = layer_take(a, &layer);
+	thread_mutex_unlock(&store.lock);
+
+	if (ok == false)
+		return NULL;
+
 	struct texture_cache tex = {
-		.coords = bitmap->coords,
+		.coords  = bitmap->coords,
+		.layer   = layer,
+		.indexed = indexed,
 	};
 
-	glGenTextures(1, &tex.id);
-	glBindTexture(GL_TEXTURE_2D, tex.id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 256, 0, GL_RGB, GL_UNSIGNED_BYTE, bitmap->rgb);
+	// Upload through the units the textures are drawn from, so that the
+	// bindings stay in place:
+	if (tex.indexed) {
+		glutil_texture(TEXTURE_CACHE_UNIT_INDEXED, GL_TEXTURE_2D_ARRAY, store.indexed.id);
+		texture_stream_upload(GL_RED, TILESIZE, TILESIZE, tex.layer, bitmap->pixels);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		// The palette is small enough to upload directly:
+		glutil_texture(TEXTURE_CACHE_UNIT_PALETTE, GL_TEXTURE_2D, store.palette);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, tex.layer, 256, 1, GL_RGB, GL_UNSIGNED_BYTE, bitmap->palette);
+	}
+	else {
+		glutil_texture(TEXTURE_CACHE_UNIT_RGBA, GL_TEXTURE_2D_ARRAY, store.rgba.id);
+		texture_stream_upload(GL_RGBA, TILESIZE, TILESIZE, tex.layer, bitmap->pixels);
+	}
 
-	return cache_insert(cache, loc, &tex);
+	// If the insert fails, the cache passes the entry to on_destroy(),
+	// which puts the layer back on the free list:
+	return cache_insert(a->cache, loc, &tex);
+}
+
+bool
+texture_cache_load (const struct bitmap_cache *bitmap, struct texture_cache *tex)
+{
+	const bool indexed = bitmap->palette != NULL;
+	struct array *a = array_of(indexed);
+	uint32_t layer;
+	bool ok = false;
+
+	// Take a layer, unless the loader threads hold their share already:
+	thread_mutex_lock(&store.lock);
+
+	if (a->loading < store.loaders && layer_take(a, &layer)) {
+		*tex = (struct texture_cache) {
+			.coords  = bitmap->coords,
+			.layer   = layer,
+			.indexed = indexed,
+		};
+
+		a->loading++;
+		ok = true;
+	}
+
+	thread_mutex_unlock(&store.lock);
+
+	if (ok == false)
+		return false;
+
+	// Upload directly from the bitmap. The loader thread has time to wait
+	// for the driver to copy the data. It has its own context, so the
+	// bindings bypass the render thread's state cache:
+	if (tex->indexed) {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, store.indexed.id);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, tex->layer, TILESIZE, TILESIZE, 1, GL_RED, GL_UNSIGNED_BYTE, bitmap->pixels);
+
+		glBindTexture(GL_TEXTURE_2D, store.palette);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, tex->layer, 256, 1, GL_RGB, GL_UNSIGNED_BYTE, bitmap->palette);
+	}
+	else {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, store.rgba.id);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, tex->layer, TILESIZE, TILESIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE, bitmap->pixels);
+	}
+
+	// Flush, so that the fence reaches the GPU and the render thread can
+	// wait on it from another context:
+	tex->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+	return true;
+}
+
+const struct texture_cache *
+texture_cache_adopt (const struct cache_node *loc, const struct texture_cache *tex)
+{
+	struct array *a = array_of(tex->indexed);
+
+	thread_mutex_lock(&store.lock);
+	a->loading--;
+	thread_mutex_unlock(&store.lock);
+
+	// On failure, on_destroy() deletes the fence and frees the layer:
+	return cache_insert(a->cache, loc, (void *) tex);
 }
 
 void
-texture_cache_destroy (void)
+texture_cache_bind (void)
 {
-	cache_destroy(cache);
+	glutil_texture(TEXTURE_CACHE_UNIT_INDEXED, GL_TEXTURE_2D_ARRAY, store.indexed.id);
+	glutil_texture(TEXTURE_CACHE_UNIT_PALETTE, GL_TEXTURE_2D,       store.palette);
+	glutil_texture(TEXTURE_CACHE_UNIT_RGBA,    GL_TEXTURE_2D_ARRAY, store.rgba.id);
 }
 
-bool
-texture_cache_create (void)
+static void
+array_destroy (struct array *a)
+{
+	cache_destroy(a->cache);
+	glDeleteTextures(1, &a->id);
+	free(a->free);
+
+	*a = (struct array) { .id = 0 };
+}
+
+static void
+store_destroy (void)
+{
+	array_destroy(&store.rgba);
+	array_destroy(&store.indexed);
+	glDeleteTextures(1, &store.palette);
+	glutil_state_reset();
+
+	store.palette = 0;
+	store.loaders = 0;
+}
+
+// Create the cache of an array, with room for all layers except the spare one
+// and the ones reserved for the loader threads:
+static struct cache *
+array_cache (const struct array *a, const uint32_t loaders)
 {
 	const struct cache_config config = {
-		.capacity  = CACHE_CAPACITY,
+		.capacity  = a->layers - 1 - loaders,
 		.destroy   = on_destroy,
 		.entrysize = sizeof (struct texture_cache),
 	};
 
-	return (cache = cache_create(&config)) != NULL;
+	return cache_create(&config);
+}
+
+// Allocate a texture array with its free list and its cache, and set its
+// filtering. The wrapping stays at the default GL_REPEAT, because the low-zoom
+// path of the spherical shader relies on it:
+static bool
+array_create (struct array *a, const GLuint unit, const GLenum format, const uint32_t layers, const GLenum min_filter)
+{
+	if ((a->free = malloc(layers * sizeof (*a->free))) == NULL)
+		return false;
+
+	a->layers  = layers;
+	a->loading = 0;
+
+	for (a->nfree = 0; a->nfree < layers; a->nfree++)
+		a->free[a->nfree] = layers - 1 - a->nfree;
+
+	if ((a->cache = array_cache(a, 0)) == NULL)
+		return false;
+
+	glGenTextures(1, &a->id);
+	glutil_texture(unit, GL_TEXTURE_2D_ARRAY, a->id);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, format, TILESIZE, TILESIZE, layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, min_filter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	return true;
+}
+
+static bool
+store_create (const uint32_t rgba, const uint32_t indexed)
+{
+	if (array_create(&store.rgba, TEXTURE_CACHE_UNIT_RGBA, GL_RGBA8, rgba, GL_LINEAR) == false)
+		return false;
+
+	// Interpolating between indices is meaningless, so always sample the
+	// nearest one:
+	if (array_create(&store.indexed, TEXTURE_CACHE_UNIT_INDEXED, GL_R8, indexed, GL_NEAREST) == false)
+		return false;
+
+	// One row per indexed layer, looked up by index in the shader:
+	glGenTextures(1, &store.palette);
+	glutil_texture(TEXTURE_CACHE_UNIT_PALETTE, GL_TEXTURE_2D, store.palette);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 256, indexed);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	return glGetError() == GL_NO_ERROR;
+}
+
+bool
+texture_cache_reserve_loaders (void)
+{
+	struct cache *rgba, *indexed;
+
+	if (store.loaders > 0)
+		return true;
+
+	if ((rgba = array_cache(&store.rgba, LOADER_LAYERS)) == NULL)
+		return false;
+
+	if ((indexed = array_cache(&store.indexed, LOADER_LAYERS)) == NULL) {
+		cache_destroy(rgba);
+		return false;
+	}
+
+	// Dropping the old caches returns their layers to the free lists:
+	cache_destroy(store.rgba.cache);
+	cache_destroy(store.indexed.cache);
+
+	store.rgba.cache    = rgba;
+	store.indexed.cache = indexed;
+	store.loaders       = LOADER_LAYERS;
+	return true;
+}
+
+void
+texture_cache_destroy (void)
+{
+	store_destroy();
+	texture_stream_destroy();
+}
+
+// Number of layers that fit in an amount of video memory, within the limits
+// of the implementation:
+static uint32_t
+layers_fit (const size_t vram, const size_t size)
+{
+	GLint max_layers, max_size;
+	uint32_t layers = vram / size;
+
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+	if (layers > (uint32_t) max_layers)
+		layers = max_layers;
+
+	// The palette texture has a row per indexed layer:
+	if (layers > (uint32_t) max_size)
+		layers = max_size;
+
+	return layers;
+}
+
+bool
+texture_cache_create (const size_t vram)
+{
+	const size_t vram_indexed = vram / 100 * INDEXED_SHARE;
+	const uint32_t rgba    = layers_fit(vram - vram_indexed, LAYER_SIZE_RGBA);
+	const uint32_t indexed = layers_fit(vram_indexed, LAYER_SIZE_INDEXED);
+
+	if (rgba < LOADER_LAYERS + 2 || indexed < LOADER_LAYERS + 2)
+		return false;
+
+	if (texture_stream_create() == false)
+		return false;
+
+	if (store_create(rgba, indexed) == false) {
+		store_destroy();
+		texture_stream_destroy();
+		return false;
+	}
+
+	return true;
 }
@@ -1,20 +1,60 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include <GL/gl.h>
+
 #include "bitmap_cache.h"
 #include "cache.h"
 #include "globe.h"
 
+// Texture units of the tile store:
+#define TEXTURE_CACHE_UNIT_RGBA		0
+#define TEXTURE_CACHE_UNIT_PALETTE	1
+#define TEXTURE_CACHE_UNIT_INDEXED	2
+
 // Data structure stored in and retrieved from the texture cache.
 struct texture_cache {
 	struct globe_tile coords;
-	uint32_t          id;
+
+	// Layer of the tile in the texture arrays of the store. RGBA tiles
+	// live in the RGBA array. Indexed tiles live in the index array, and
+	// their palette in the same row of the palette texture.
+	uint32_t layer;
+	bool     indexed;
+
+	// Fence after an upload by a loader thread. The render thread waits
+	// on it before the first use.
+	GLsync fence;
 };
 
 extern const struct texture_cache *texture_cache_search (const struct cache_node *in, struct cache_node *out);
+
+// Upload a bitmap and insert it into the cache. Returns NULL if the upload
+// could not be started in this frame.
 extern const struct texture_cache *texture_cache_insert (const struct cache_node *loc, const struct bitmap_cache *bitmap);
 
+// Upload a bitmap from a loader thread with a shared context current. On
+// success, the texture is ready to be adopted by the render thread. Returns
+// false if no layer is available for loader uploads.
+extern bool texture_cache_load (const struct bitmap_cache *bitmap, struct texture_cache *tex);
+
+// Insert a texture uploaded by a loader thread into the cache.
+extern const struct texture_cache *texture_cache_adopt (const struct cache_node *loc, const struct texture_cache *tex);
+
+// Set aside layers for the loader threads to upload to, which shrinks the
+// caches. Call it once before enabling loader uploads. The cached textures are
+// dropped.
+extern bool texture_cache_reserve_loaders (void);
+
+// Bind the texture arrays of the store to their texture units.
+extern void texture_cache_bind (void);
+
 extern void texture_cache_destroy (void);
-extern bool texture_cache_create  (void);
+
+// Create the cache with as many tiles as fit in the given amount of video
+// memory in bytes. RGBA and indexed tiles each get half of it, so an indexed
+// tile costs a quarter of an RGBA tile.
+extern bool texture_cache_create (const size_t vram);
@@ -0,0 +1,168 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include <GL/gl.h>
+
+#include "texture_stream.h"
+#include "util.h"
+
+// Number of uploads that can be in flight, and the size of one upload:
+#define RING_SLOTS	16
+#define SLOT_SIZE	(256 * 256 * 4)
+
+// A ring of slots in one persistently mapped pixel unpack buffer. The render
+// thread copies pixel data into a slot and starts a transfer from the buffer
+// to the texture, which the driver completes asynchronously. A fence is placed
+// after the transfer. The slot is reused only after its fence has signaled, so
+// the CPU never overwrites data that the GPU is still reading.
+static struct {
+	GLuint   pbo;
+	uint8_t *map;
+	GLsync   fence[RING_SLOTS];
+	uint32_t next;
+} ring;
+
+static struct texture_stream_stats stats[2];
+
+// Persistent mapping needs OpenGL 4.4 or the buffer storage extension:
+static bool
+supported (void)
+{
+	GLint major, minor, num;
+
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	if (major > 4 || (major == 4 && minor >= 4))
+		return true;
+
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num);
+
+	for (GLint i = 0; i < num; i++)
+		if (strcmp((const char *) glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage") == 0)
+			return true;
+
+	return false;
+}
+
+// Check whether the GPU is done with a slot, without waiting:
+static bool
+slot_free (const uint32_t slot)
+{
+	if (ring.fence[slot] == NULL)
+		return true;
+
+	switch (glClientWaitSync(ring.fence[slot], 0, 0)) {
+	case GL_ALREADY_SIGNALED:
+	case GL_CONDITION_SATISFIED:
+		glDeleteSync(ring.fence[slot]);
+		ring.fence[slot] = NULL;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+bool
+texture_stream_ready (void)
+{
+	// Without a ring, uploads are always synchronous:
+	if (ring.map == NULL)
+		return true;
+
+	return slot_free(ring.next);
+}
+
+bool
+texture_stream_upload (const GLenum format, const uint16_t width, const uint16_t height, const uint32_t layer, const void *pixels)
+{
+	const size_t size = (size_t) width * height * (format == GL_RED ? 1 : format == GL_RGB ? 3 : 4);
+
+	// Fall back to a direct upload if there is no ring:
+	if (ring.map == NULL || size > SLOT_SIZE) {
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE, pixels);
+		stats[0].bytes += size;
+		stats[0].uploads++;
+		return true;
+	}
+
+	if (slot_free(ring.next) == false) {
+		stats[0].refused++;
+		return false;
+	}
+
+	const size_t offset = (size_t) ring.next * SLOT_SIZE;
+
+	// The mapping is coherent, so the copy is visible to the GPU without
+	// an explicit flush:
+	memcpy(ring.map + offset, pixels, size);
+
+	// With an unpack buffer bound, the data pointer is a buffer offset:
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.pbo);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE, (const void *) offset);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	ring.fence[ring.next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring.next = (ring.next + 1) % RING_SLOTS;
+
+	stats[0].bytes += size;
+	stats[0].uploads++;
+	return true;
+}
+
+void
+texture_stream_frame (void)
+{
+	stats[1] = stats[0];
+	stats[0] = (struct texture_stream_stats) { 0 };
+}
+
+const struct texture_stream_stats *
+texture_stream_stats (void)
+{
+	return &stats[1];
+}
+
+void
+texture_stream_destroy (void)
+{
+	FOREACH (ring.fence, fence)
+		if (*fence != NULL)
+			glDeleteSync(*fence);
+
+	if (ring.pbo) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.pbo);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &ring.pbo);
+	}
+
+	memset(&ring, 0, sizeof (ring));
+}
+
+bool
+texture_stream_create (void)
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	memset(&ring,  0, sizeof (ring));
+	memset(&stats, 0, sizeof (stats));
+
+	// Without persistent mapping, fall back to synchronous uploads:
+	if (supported() == false)
+		return true;
+
+	glGenBuffers(1, &ring.pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.pbo);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, RING_SLOTS * SLOT_SIZE, NULL, flags);
+	ring.map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, RING_SLOTS * SLOT_SIZE, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (ring.map == NULL) {
+		glDeleteBuffers(1, &ring.pbo);
+		ring.pbo = 0;
+	}
+
+	return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/gl.h>
+
+// Upload statistics for one frame.
+struct texture_stream_stats {
+
+	// Number of bytes and images uploaded.
+	size_t   bytes;
+	uint32_t uploads;
+
+	// Number of uploads refused because the ring had no free slot.
+	uint32_t refused;
+};
+
+// Check whether an upload can be started without waiting for the GPU.
+extern bool texture_stream_ready (void);
+
+// Upload pixel data to a layer of the texture array bound to
+// GL_TEXTURE_2D_ARRAY. The data is copied, so the source can be released when
+// this function returns. Fails only if texture_stream_ready() would have
+// returned false.
+extern bool texture_stream_upload (const GLenum format, const uint16_t width, const uint16_t height, const uint32_t layer, const void *pixels);
+
+// Mark the start of a new frame.
+extern void texture_stream_frame (void);
+
+// Get the statistics of the last complete frame.
+extern const struct texture_stream_stats *texture_stream_stats (void);
+
+extern void texture_stream_destroy (void);
+extern bool texture_stream_create  (void);
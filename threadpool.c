@@ -8,6 +8,7 @@
 
 struct threadpool {
 	void                     *jobs;
+	bool                     *low;
 	pthread_t                *threads;
 	struct threadpool_config  config;
 
@@ -16,6 +17,8 @@ struct threadpool {
 
 	struct {
 		size_t jobs;
+		size_t low;
+		size_t busy;
 		size_t threads;
 	} num;
 
@@ -29,36 +32,127 @@ jobslot (struct threadpool *p, const size_t n)
 	return (char *) p->jobs + n * p->config.jobsize;
 }
 
-// Insert a job into the job queue. Needs mutex!
+// Move the last job into a vacated slot. Needs mutex!
+static void
+job_vacate (struct threadpool *p, const size_t n)
+{
+	if (p->low[n])
+		p->num.low--;
+
+	if (--p->num.jobs == n)
+		return;
+
+	memcpy(jobslot(p, n), jobslot(p, p->num.jobs), p->config.jobsize);
+	p->low[n] = p->low[p->num.jobs];
+}
+
+// Find the queued job of a priority class that comes last in the user's
+// ordering. Returns the number of jobs if there is none. Needs mutex!
+static size_t
+job_last (struct threadpool *p, const bool low)
+{
+	size_t n = p->num.jobs;
+
+	for (size_t i = 0; i < p->num.jobs; i++)
+		if (p->low[i] == low)
+			if (n == p->num.jobs || p->config.before(jobslot(p, n), jobslot(p, i)))
+				n = i;
+
+	return n;
+}
+
+// Make room for a job by dropping a queued job. Low priority jobs are dropped
+// first, other jobs only if the new job comes before them. Needs mutex!
 static bool
-job_insert (struct threadpool *p, void *job)
+job_evict (struct threadpool *p, const void *job, const bool low)
 {
-	// Fail if the job queue is at capacity:
-	if (p->num.jobs == p->config.num.jobs)
+	// Without an ordering, the queue works first come, first served:
+	if (p->config.before == NULL)
+		return false;
+
+	const bool victim = low || p->num.low > 0;
+	const size_t n = job_last(p, victim);
+
+	if (n == p->num.jobs)
+		return false;
+
+	if (victim == low && p->config.before(job, jobslot(p, n)) == false)
 		return false;
 
+	if (p->config.drop)
+		p->config.drop(jobslot(p, n));
+
+	job_vacate(p, n);
+	return true;
+}
+
+// Insert a job into the job queue. Low priority jobs may take up at most half
+// of the queue, so that they cannot crowd out regular jobs. Needs mutex!
+static bool
+job_insert (struct threadpool *p, void *job, const bool low)
+{
+	// Make room if the job queue is at capacity:
+	if (p->num.jobs == p->config.num.jobs || (low && p->num.low >= p->config.num.jobs / 2))
+		if (job_evict(p, job, low) == false)
+			return false;
+
+	p->low[p->num.jobs] = low;
+	p->num.low += low;
 	memcpy(jobslot(p, p->num.jobs++), job, p->config.jobsize);
 	return true;
 }
 
-// Extract the first job from the job queue. Needs mutex!
+// Extract the first regular job from the job queue, or the first low priority
+// job if there are no regular jobs. If the user provides an ordering, take the
+// job that comes first in that order. Needs mutex!
 static bool
 job_take (struct threadpool *p, void *result)
 {
+	size_t n = p->num.jobs;
+
 	// Fail if there are no pending jobs:
 	if (p->num.jobs == 0)
 		return false;
 
-	// Return first job in queue:
-	memcpy(result, jobslot(p, 0), p->config.jobsize);
+	const bool low = p->num.low == p->num.jobs;
 
-	// Copy last job to first slot:
-	if (--p->num.jobs)
-		memcpy(jobslot(p, 0), jobslot(p, p->num.jobs), p->config.jobsize);
+	for (size_t i = 0; i < p->num.jobs; i++) {
+		if (p->low[i] != low)
+			continue;
 
+		if (n == p->num.jobs)
+			n = i;
+		else if (p->config.before && p->config.before(jobslot(p, i), jobslot(p, n)))
+			n = i;
+		else if (p->config.before == NULL)
+			break;
+	}
+
+	memcpy(result, jobslot(p, n), p->config.jobsize);
+	job_vacate(p, n);
 	return true;
 }
 
+// Remove all queued jobs for which the match function returns true. Needs
+// mutex! Returns the number of jobs removed.
+static size_t
+job_remove (struct threadpool *p, bool (* match) (const void *job, const void *arg), const void *arg)
+{
+	size_t removed = 0;
+
+	for (size_t i = 0; i < p->num.jobs; ) {
+		if (match(jobslot(p, i), arg) == false) {
+			i++;
+			continue;
+		}
+
+		job_vacate(p, i);
+		removed++;
+	}
+
+	return removed;
+}
+
 static void *
 thread_main (void *data)
 {
@@ -79,12 +173,23 @@ thread_main (void *data)
 		while (!(job_take(p, job) || p->shutdown))
 			thread_cond_wait(&p->cond, &p->cond_mutex);
 
+		// Count the job as running until it returns:
+		p->num.busy += (p->shutdown == false);
+
 		// Unlock the condition mutex to release the job structure:
 		thread_mutex_unlock(&p->cond_mutex);
 
+		if (p->shutdown)
+			break;
+
 		// Run user-provided routine on data:
-		if (p->shutdown == false)
-			p->config.process(job);
+		p->config.process(job);
+
+		if (thread_mutex_lock(&p->cond_mutex) == false)
+			break;
+
+		p->num.busy--;
+		thread_mutex_unlock(&p->cond_mutex);
 	}
 
 	free(job);
@@ -114,8 +219,8 @@ threads_create (struct threadpool *p)
 	return true;
 }
 
-bool
-threadpool_job_enqueue (struct threadpool *p, void *job)
+static bool
+enqueue (struct threadpool *p, void *job, const bool low)
 {
 	bool ret;
 
@@ -123,7 +228,7 @@ threadpool_job_enqueue (struct threadpool *p, void *job)
 		return false;
 
 	if ((ret = thread_mutex_lock(&p->cond_mutex))) {
-		if ((ret = job_insert(p, job)))
+		if ((ret = job_insert(p, job, low)))
 			thread_cond_signal(&p->cond);
 
 		thread_mutex_unlock(&p->cond_mutex);
@@ -132,6 +237,50 @@ threadpool_job_enqueue (struct threadpool *p, void *job)
 	return ret;
 }
 
+bool
+threadpool_job_enqueue (struct threadpool *p, void *job)
+{
+	return enqueue(p, job, false);
+}
+
+bool
+threadpool_job_enqueue_low (struct threadpool *p, void *job)
+{
+	return enqueue(p, job, true);
+}
+
+size_t
+threadpool_job_cancel (struct threadpool *p, bool (* match) (const void *job, const void *arg), const void *arg)
+{
+	size_t removed = 0;
+
+	if (p == NULL)
+		return 0;
+
+	if (thread_mutex_lock(&p->cond_mutex)) {
+		removed = job_remove(p, match, arg);
+		thread_mutex_unlock(&p->cond_mutex);
+	}
+
+	return removed;
+}
+
+bool
+threadpool_idle (struct threadpool *p)
+{
+	bool idle = true;
+
+	if (p == NULL)
+		return true;
+
+	if (thread_mutex_lock(&p->cond_mutex)) {
+		idle = p->num.jobs == 0 && p->num.busy == 0;
+		thread_mutex_unlock(&p->cond_mutex);
+	}
+
+	return idle;
+}
+
 struct threadpool *
 threadpool_create (const struct threadpool_config *config)
 {
@@ -150,23 +299,27 @@ threadpool_create (const struct threadpool_config *config)
 	if ((p->jobs = calloc(config->num.jobs, config->jobsize)) == NULL)
 		goto err1;
 
-	if ((p->threads = calloc(config->num.threads, sizeof (pthread_t))) == NULL)
+	if ((p->low = calloc(config->num.jobs, sizeof (bool))) == NULL)
 		goto err2;
 
-	if (thread_mutex_init(&p->cond_mutex) == false)
+	if ((p->threads = calloc(config->num.threads, sizeof (pthread_t))) == NULL)
 		goto err3;
 
-	if (thread_cond_init(&p->cond) == false)
+	if (thread_mutex_init(&p->cond_mutex) == false)
 		goto err4;
 
-	if (threads_create(p) == false)
+	if (thread_cond_init(&p->cond) == false)
 		goto err5;
 
+	if (threads_create(p) == false)
+		goto err6;
+
 	return p;
 
-err5:	thread_cond_destroy(&p->cond);
-err4:	thread_mutex_destroy(&p->cond_mutex);
-err3:	free(p->threads);
+err6:	thread_cond_destroy(&p->cond);
+err5:	thread_mutex_destroy(&p->cond_mutex);
+err4:	free(p->threads);
+err3:	free(p->low);
 err2:	free(p->jobs);
 err1:	free(p);
 err0:	return NULL;
@@ -184,6 +337,7 @@ threadpool_destroy (struct threadpool *p)
 	thread_cond_destroy(&p->cond);
 
 	free(p->threads);
+	free(p->low);
 	free(p->jobs);
 	free(p);
 }
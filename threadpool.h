@@ -15,6 +15,13 @@ struct threadpool_config {
 	// Size of a job structure in bytes.
 	size_t jobsize;
 
+	// Optional: return true if job a should run before job b. When the
+	// queue is full, a new job then replaces a queued job that comes later.
+	bool (* before) (const void *a, const void *b);
+
+	// Optional: called on a queued job that was replaced.
+	void (* drop) (void *job);
+
 	struct {
 
 		// Size of the job queue.
@@ -33,5 +40,19 @@ extern struct threadpool *threadpool_create (const struct threadpool_config *con
 // Enqueue the job specified by the opaque data pointer into the threadpool.
 extern bool threadpool_job_enqueue (struct threadpool *p, void *job);
 
+// Enqueue a job that only runs when no regular jobs are waiting. Low priority
+// jobs can occupy at most half of the job queue, and are replaced first when
+// the queue is full.
+extern bool threadpool_job_enqueue_low (struct threadpool *p, void *job);
+
+// Remove the queued jobs for which the match function returns true. Jobs that
+// a worker thread has already started are not affected. Returns the number of
+// jobs removed.
+extern size_t threadpool_job_cancel (struct threadpool *p, bool (* match) (const void *job, const void *arg), const void *arg);
+
+// Returns true if no jobs are queued and no worker thread is running a job.
+// Everything that finished jobs did is visible to the caller.
+extern bool threadpool_idle (struct threadpool *p);
+
 // Destroy the threadpool structure and all associated resources:
 extern void threadpool_destroy (struct threadpool *p);
@@ -1,5 +1,10 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <GL/gl.h>
 
+#include "glutil.h"
 #include "tiledrawer.h"
 #include "programs.h"
 #include "program/spherical.h"
@@ -16,40 +21,154 @@ static const uint8_t vertex_index[] = {
 	0, 1, 2,
 };
 
+// Per-instance data for one tile, read by the vertex shader:
+struct instance {
+	uint32_t x;
+	uint32_t y;
+	uint32_t zoom;
+	struct globe_tile coords;
+	uint32_t layer;
+	uint32_t indexed;
+} __attribute__((packed,aligned(4)));
+
 static struct {
 	uint32_t vao;
+	uint32_t vbo;
+	uint32_t ibo;
+	bool     init;
+	bool     single;
+
+	// Instances collected in this frame:
+	struct instance *inst;
+	size_t           used;
+	size_t           size;
+
+	// Size of the GL instance buffer in instances:
+	size_t           vbo_size;
 } state;
 
+static void
+init (void)
+{
+	glGenVertexArrays(1, &state.vao);
+	glGenBuffers(1, &state.vbo);
+	glGenBuffers(1, &state.ibo);
+
+	glutil_vertex_array(state.vao);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state.ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof (vertex_index), vertex_index, GL_STATIC_DRAW);
+
+	// All attributes advance once per instance:
+	glBindBuffer(GL_ARRAY_BUFFER, state.vbo);
+
+	const GLuint xyz = program_spherical_loc_tile_xyz();
+	glEnableVertexAttribArray(xyz);
+	glVertexAttribIPointer(xyz, 3, GL_UNSIGNED_INT, sizeof (struct instance),
+		(void *) offsetof(struct instance, x));
+	glVertexAttribDivisor(xyz, 1);
+
+	// The corners form a matrix of four columns, one attribute each:
+	const GLuint vertex = program_spherical_loc_tile_vertex();
+	for (GLuint i = 0; i < 4; i++) {
+		glEnableVertexAttribArray(vertex + i);
+		glVertexAttribPointer(vertex + i, 3, GL_FLOAT, GL_FALSE, sizeof (struct instance),
+			(void *) (offsetof(struct instance, coords) + i * sizeof (struct globe_point)));
+		glVertexAttribDivisor(vertex + i, 1);
+	}
+
+	const GLuint tex = program_spherical_loc_tile_tex();
+	glEnableVertexAttribArray(tex);
+	glVertexAttribIPointer(tex, 2, GL_UNSIGNED_INT, sizeof (struct instance),
+		(void *) offsetof(struct instance, layer));
+	glVertexAttribDivisor(tex, 1);
+
+	glutil_vertex_array(0);
+	state.init = true;
+}
+
 void
 tiledrawer (const struct tiledrawer *td)
 {
 	if (td->tex == NULL)
 		return;
 
-	// Set tile zoom level:
-	program_spherical_set_tile(td->tile, &td->tex->coords);
+	if (state.used == state.size) {
+		const size_t size = state.size ? state.size * 2 : 256;
+		struct instance *inst;
 
-	// Bind texture:
-	glBindTexture(GL_TEXTURE_2D, td->tex->id);
+		if ((inst = realloc(state.inst, size * sizeof (*inst))) == NULL)
+			return;
 
-	// Draw two triangles which together form one quad:
-	glDrawElements(GL_TRIANGLES, sizeof (vertex_index), GL_UNSIGNED_BYTE, vertex_index);
+		state.inst = inst;
+		state.size = size;
+	}
+
+	state.inst[state.used++] = (struct instance) {
+		.x       = td->tile->x,
+		.y       = td->tile->y,
+		.zoom    = td->tile->zoom,
+		.coords  = td->tex->coords,
+		.layer   = td->tex->layer,
+		.indexed = td->tex->indexed,
+	};
 }
 
 void
-tiledrawer_start (const struct camera *cam, const struct viewport *vp)
+tiledrawer_start (void)
 {
-	static bool init = false;
-
 	// Lazy init:
-	if (init == false) {
-		glGenVertexArrays(1, &state.vao);
-		init = true;
+	if (state.init == false)
+		init();
+
+	state.used = 0;
+
+	glutil_vertex_array(state.vao);
+	program_spherical_use();
+
+	// All tiles are drawn from the same texture arrays:
+	texture_cache_bind();
+}
+
+void
+tiledrawer_end (void)
+{
+	if (state.used > 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, state.vbo);
+
+		// Grow the buffer if needed, else orphan it so that the driver
+		// does not wait for the previous frame to finish with it:
+		if (state.used > state.vbo_size)
+			state.vbo_size = state.size;
+
+		glBufferData(GL_ARRAY_BUFFER, state.vbo_size * sizeof (struct instance), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, state.used * sizeof (struct instance), state.inst);
+
+		if (state.single)
+			for (size_t i = 0; i < state.used; i++)
+				glDrawElementsInstancedBaseInstance(GL_TRIANGLES, sizeof (vertex_index), GL_UNSIGNED_BYTE, NULL, 1, i);
+		else
+			glDrawElementsInstanced(GL_TRIANGLES, sizeof (vertex_index), GL_UNSIGNED_BYTE, NULL, state.used);
 	}
 
-	glBindVertexArray(state.vao);
-	program_spherical_use(cam, vp);
+	glutil_vertex_array(0);
+}
+
+void
+tiledrawer_set_instanced (const bool instanced)
+{
+	state.single = !instanced;
+}
+
+void
+tiledrawer_destroy (void)
+{
+	if (state.init) {
+		glDeleteBuffers(1, &state.ibo);
+		glDeleteBuffers(1, &state.vbo);
+		glDeleteVertexArrays(1, &state.vao);
+	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glEnable(GL_TEXTURE_2D);
+	free(state.inst);
+	memset(&state, 0, sizeof (state));
 }
@@ -1,16 +1,23 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "cache.h"
-#include "camera.h"
 #include "texture_cache.h"
-#include "viewport.h"
 
 struct tiledrawer {
 	const struct cache_node    *tile;
 	const struct texture_cache *tex;
 };
 
+// Tiles are collected between tiledrawer_start() and tiledrawer_end(), and
+// drawn together in one instanced draw call.
 extern void tiledrawer       (const struct tiledrawer *);
-extern void tiledrawer_start (const struct camera *, const struct viewport *);
+extern void tiledrawer_start (void);
+extern void tiledrawer_end   (void);
+
+// Draw every tile with its own draw call instead, for comparison.
+extern void tiledrawer_set_instanced (const bool instanced);
+
+extern void tiledrawer_destroy (void);
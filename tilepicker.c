@@ -1,170 +1,309 @@
 #include <stdint.h>
-#include <stdio.h>
-#include <math.h>
-#include <GL/gl.h>
-
-#include "camera.h"
-#include "glutil.h"
-#include "program.h"
-#include "program/tilepicker.h"
+#include <stdlib.h>
+#include <string.h>
+
 #include "tilepicker.h"
+#include "tilepicker/local.h"
 #include "util.h"
 
-#define	IMGSIZE	64
+// The implementation is chosen per build, and can be changed at runtime:
+#ifndef TILEPICKER_MODE
+#define TILEPICKER_MODE	TILEPICKER_GPU
+#endif
+
+#define ZOOM_LEVELS	20
+
+static enum tilepicker_mode mode = TILEPICKER_MODE;
 
-static struct pixel {
-	struct tilepicker tile;
-	uint32_t valid;
-} __attribute__((packed)) imgbuf[IMGSIZE * IMGSIZE];
+// Visible tiles at every zoom level, the number of window pixels covered by
+// each tile, and its position in the previous result. Tiles are deduplicated
+// through an open addressing hash table of indices into the tile array:
+struct bucket {
+	struct tilepicker *tile;
+	uint32_t *coverage;
+	int32_t  *previous;
+	uint32_t *slot;
+	size_t used;
+	size_t size;
+	size_t nslots;
+};
+
+// The current and the previous result. They swap roles on every new result:
+static struct bucket  set[2][ZOOM_LEVELS];
+static struct bucket *bucket = set[0];
+static struct bucket *prev   = set[1];
+
+// Tiles that left the visible set with the current result:
+static struct {
+	struct tilepicker *tile;
+	size_t used;
+	size_t size;
+} left;
 
-static GLuint vao;
-static GLuint fbo;
-static GLuint rbo;
-static GLint fb_orig[2];
-static GLint vp_orig[4];
+static uint32_t serial;
 
-static void fbo_bind (void)
+static inline uint32_t
+hash (const uint32_t x, const uint32_t y)
 {
-	// Save current framebuffer bindings to restore them later:
-	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fb_orig[0]);
-	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &fb_orig[1]);
+	return (x * 0x9E3779B1u) ^ (y * 0x85EBCA77u);
+}
+
+// Find the slot of a tile, or the empty slot where it should go. Slots hold
+// the tile index plus one, so that zero means empty:
+static uint32_t *
+slot_find (const struct bucket *b, const uint32_t x, const uint32_t y)
+{
+	const size_t mask = b->nslots - 1;
+
+	for (size_t i = hash(x, y) & mask;; i = (i + 1) & mask) {
+		uint32_t *slot = &b->slot[i];
 
-	// Save original viewport dimensions:
-	glGetIntegerv(GL_VIEWPORT, vp_orig);
+		if (*slot == 0)
+			return slot;
 
-	// Set new viewport dimensions:
-	glViewport(0, 0, IMGSIZE, IMGSIZE);
+		const struct tilepicker *t = &b->tile[*slot - 1];
 
-	// Bind own framebuffer for drawing and reading:
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		if (t->x == x && t->y == y)
+			return slot;
+	}
 }
 
-static void fbo_unbind (void)
+// Grow the tile arrays, and keep the hash table at most half full:
+static bool
+bucket_grow (struct bucket *b)
 {
-	// Restore original viewport dimensions:
-	glViewport(vp_orig[0], vp_orig[1], vp_orig[2], vp_orig[3]);
+	const size_t size = b->size ? b->size * 2 : 64;
+	struct tilepicker *tile;
+	uint32_t *coverage, *slot;
+	int32_t *previous;
+
+	if ((tile = realloc(b->tile, size * sizeof (*tile))) == NULL)
+		return false;
+
+	b->tile = tile;
+
+	if ((coverage = realloc(b->coverage, size * sizeof (*coverage))) == NULL)
+		return false;
+
+	b->coverage = coverage;
+
+	if ((previous = realloc(b->previous, size * sizeof (*previous))) == NULL)
+		return false;
+
+	b->previous = previous;
+
+	if ((slot = calloc(size * 2, sizeof (*slot))) == NULL)
+		return false;
+
+	free(b->slot);
+	b->slot   = slot;
+	b->size   = size;
+	b->nslots = size * 2;
 
-	// Restore original framebuffer bindings:
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fb_orig[0]);
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, fb_orig[1]);
+	// Rehash the existing tiles:
+	for (size_t i = 0; i < b->used; i++)
+		*slot_find(b, b->tile[i].x, b->tile[i].y) = i + 1;
+
+	return true;
 }
 
-static void
-init (void)
+// Check whether a tile is in a bucket:
+static bool
+bucket_find (const struct bucket *b, const struct tilepicker *tile, size_t *index)
 {
-	static const struct glutil_vertex verts[4] = {
-		[0] = { -1.0, -1.0 },
-		[1] = {  1.0, -1.0 },
-		[2] = {  1.0,  1.0 },
-		[3] = { -1.0,  1.0 },
-	};
+	const uint32_t *slot;
 
-	glGenVertexArrays(1, &vao);
-	glGenFramebuffers(1, &fbo);
-	glGenRenderbuffers(1, &rbo);
+	if (b->used == 0 || *(slot = slot_find(b, tile->x, tile->y)) == 0)
+		return false;
 
-	glBindVertexArray(vao);
+	*index = *slot - 1;
+	return true;
+}
 
-	// Map 'vertex' attribute to a member of struct glutil_vertex:
-	glutil_vertex_link(program_tilepicker_loc_vertex());
+void
+tilepicker_buckets_reset (void)
+{
+	// Keep the current result as the previous one:
+	struct bucket *b = prev;
 
-	// Copy vertices to buffer:
-	glBufferData(GL_ARRAY_BUFFER, sizeof (verts), verts, GL_STATIC_DRAW);
+	prev   = bucket;
+	bucket = b;
 
-	// Unbind array:
-	glBindVertexArray(0);
+	FOREACH_NELEM (bucket, ZOOM_LEVELS, b) {
+		if (b->used == 0)
+			continue;
 
-	// Create renderbuffer storage and attach to framebuffer:
-	fbo_bind();
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA32UI, IMGSIZE, IMGSIZE);
-	fbo_unbind();
+		memset(b->slot, 0, b->nslots * sizeof (*b->slot));
+		b->used = 0;
+	}
 }
 
-static void
-render (const struct viewport *vp, const struct camera *cam)
+static bool
+left_add (const struct tilepicker *tile)
 {
-	// Use the tilepicker program:
-	program_tilepicker_use(&(struct program_tilepicker) {
-		.cam        = vp->cam_pos,
-		.mat_mv_inv = vp->invert32.modelview,
-		.vp_angle   = cam->view_angle * (IMGSIZE + 2) / IMGSIZE,
-		.vp_height  = vp->height,
-		.vp_width   = vp->width,
-	});
+	if (left.used == left.size) {
+		const size_t size = left.size ? left.size * 2 : 64;
+		struct tilepicker *t;
 
-	// Use framebuffer object:
-	fbo_bind();
-	glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
-	glClear(GL_COLOR_BUFFER_BIT);
+		if ((t = realloc(left.tile, size * sizeof (*t))) == NULL)
+			return false;
 
-	// Draw the quad:
-	glBindVertexArray(vao);
-	glutil_draw_quad();
-	program_none();
-	glBindVertexArray(0);
+		left.tile = t;
+		left.size = size;
+	}
 
-	// Read back the renderbuffer contents:
-	glFramebufferRenderbuffer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
-	glReadBuffer(GL_COLOR_ATTACHMENT0);
-	glReadPixels(0, 0, IMGSIZE, IMGSIZE, GL_RGBA_INTEGER, GL_UNSIGNED_INT, imgbuf);
-	fbo_unbind();
+	left.tile[left.used++] = *tile;
+	return true;
 }
 
-// Array with 100 tiles at every zoom level:
-static struct bucket {
-	size_t used;
-	struct tilepicker tile[100];
-} bucket[20];
+void
+tilepicker_buckets_commit (void)
+{
+	size_t offset[ZOOM_LEVELS], n = 0, index;
+
+	// Offset of each zoom level in the iteration order of the previous
+	// result, which runs from the highest zoom level to the lowest:
+	for (int z = ZOOM_LEVELS - 1; z >= 0; z--) {
+		offset[z] = n;
+		n += prev[z].used;
+	}
+
+	// Find the tiles that were already visible:
+	for (size_t z = 0; z < ZOOM_LEVELS; z++)
+		FOREACH_NELEM (bucket[z].tile, bucket[z].used, t)
+			bucket[z].previous[t - bucket[z].tile] = bucket_find(&prev[z], t, &index)
+				? (int32_t) (offset[z] + index)
+				: -1;
+
+	// Find the tiles that are no longer visible:
+	left.used = 0;
 
-static void
-add_tile_to_bucket (const struct tilepicker *tile)
+	for (size_t z = 0; z < ZOOM_LEVELS; z++)
+		FOREACH_NELEM (prev[z].tile, prev[z].used, t)
+			if (bucket_find(&bucket[z], t, &index) == false)
+				if (left_add(t) == false)
+					break;
+
+	serial++;
+}
+
+void
+tilepicker_bucket_add (const struct tilepicker *tile, const uint32_t coverage)
 {
 	struct bucket *b = &bucket[tile->zoom];
 
-	// Return if bucket is already at capacity:
-	if (b->used == NELEM(b->tile))
+	// Allocate the bucket on first use:
+	if (b->size == 0 && bucket_grow(b) == false)
 		return;
 
+	uint32_t *slot = slot_find(b, tile->x, tile->y);
+
 	// Check if tile is already in the bucket:
-	FOREACH_NELEM (b->tile, b->used, bp)
-		if (bp->x == tile->x && bp->y == tile->y)
+	if (*slot != 0) {
+		b->coverage[*slot - 1] += coverage;
+		return;
+	}
+
+	// Grow the bucket if needed, and find the slot again:
+	if (b->used == b->size) {
+		if (bucket_grow(b) == false)
 			return;
 
+		slot = slot_find(b, tile->x, tile->y);
+	}
+
 	// Add tile to bucket:
-	b->tile[b->used++] = *tile;
+	b->coverage[b->used] = coverage;
+	b->tile[b->used++]   = *tile;
+	*slot = b->used;
 }
 
-static void
-populate_buckets (void)
+void
+tilepicker_destroy (void)
 {
-	// Reset buckets:
-	FOREACH (bucket, b)
-		b->used = 0;
+	for (int i = 0; i < 2; i++)
+		FOREACH (set[i], b) {
+			free(b->tile);
+			free(b->coverage);
+			free(b->previous);
+			free(b->slot);
+			*b = (struct bucket) { .used = 0 };
+		}
+
+	free(left.tile);
+	left.tile = NULL;
+	left.used = left.size = 0;
+}
 
-	// Loop over all pixels in imgbuf, add to bucket:
-	FOREACH (imgbuf, p)
-		if (p->valid)
-			add_tile_to_bucket(&p->tile);
+void
+tilepicker_set_mode (const enum tilepicker_mode m)
+{
+	mode = m;
 }
 
 void
-tilepicker_recalc (const struct viewport *vp, const struct camera *cam)
+tilepicker_set_quality (const float quality, const bool refine)
 {
-	static bool init_done = false;
+	tilepicker_gpu_set_quality(quality, refine);
+}
 
-	// Lazy init:
-	if (init_done == false) {
-		init();
-		init_done = true;
+void
+tilepicker_recalc (const struct viewport *vp, const struct camera *cam)
+{
+	switch (mode) {
+	case TILEPICKER_GPU:
+		tilepicker_gpu_recalc(vp, cam);
+		break;
+
+	case TILEPICKER_CPU:
+		tilepicker_cpu_recalc(vp, cam);
+		break;
 	}
+}
+
+void
+tilepicker_predict (const struct viewport *vp, const struct camera *cam,
+	void (* cb) (const struct tilepicker *tile, const uint32_t coverage, void *arg), void *arg)
+{
+	tilepicker_cpu_select(vp, cam, cb, arg);
+}
+
+bool
+tilepicker_update (void)
+{
+	// The CPU implementation delivers its result immediately:
+	return mode == TILEPICKER_GPU
+		? tilepicker_gpu_update()
+		: false;
+}
+
+uint32_t
+tilepicker_coverage (const struct tilepicker *tile)
+{
+	const struct bucket *b = &bucket[tile->zoom];
+
+	return b->coverage[tile - b->tile];
+}
 
-	// Render tile zoom info to buffer:
-	render(vp, cam);
+int32_t
+tilepicker_previous (const struct tilepicker *tile)
+{
+	const struct bucket *b = &bucket[tile->zoom];
 
-	// Populate buckets:
-	populate_buckets();
+	return b->previous[tile - b->tile];
+}
+
+const struct tilepicker *
+tilepicker_left (size_t *n)
+{
+	*n = left.used;
+	return left.tile;
+}
+
+uint32_t
+tilepicker_serial (void)
+{
+	return serial;
 }
 
 static size_t walk_zoom;
@@ -191,7 +330,7 @@ const struct tilepicker *
 tilepicker_first (void)
 {
 	// Walk the list from the highest zoom level to the lowest:
-	walk_zoom  = NELEM(bucket) - 1;
+	walk_zoom  = ZOOM_LEVELS - 1;
 	walk_index = 0;
 	return tilepicker_next();
 }
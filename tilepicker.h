@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "camera.h"
@@ -12,6 +13,54 @@ struct tilepicker {
 	uint32_t zoom;
 } __attribute__((packed));
 
+// Implementations of the tile selection. The GPU implementation renders and
+// reads back a small image of the tile under every pixel. The CPU
+// implementation traverses the tile quadtree, does not need a GL context,
+// and delivers its result immediately.
+enum tilepicker_mode {
+	TILEPICKER_GPU,
+	TILEPICKER_CPU,
+};
+
+extern void tilepicker_set_mode (const enum tilepicker_mode mode);
+
+// Set the sampling density of the GPU implementation. Its image has about one
+// sample per 16 window pixels at quality 1, and more rows for a tilted camera.
+// With refinement, cells whose neighbours disagree on the zoom level are
+// sampled again at four times the resolution.
+extern void tilepicker_set_quality (const float quality, const bool refine);
+
+// Start recalculating the visible tiles. The result becomes available on a
+// later call to tilepicker_update().
 extern void tilepicker_recalc (const struct viewport *vp, const struct camera *cam);
+
+// Select the visible tiles for a camera pose that is not the current one, such
+// as a predicted pose, and pass them to a callback along with their coverage
+// in window pixels. This uses the CPU implementation and leaves the current
+// result alone.
+extern void tilepicker_predict (const struct viewport *vp, const struct camera *cam,
+	void (* cb) (const struct tilepicker *tile, const uint32_t coverage, void *arg), void *arg);
+
+// Pick up the newest completed recalculation, if any. Returns true if more
+// results are still pending.
+extern bool tilepicker_update (void);
+
 extern const struct tilepicker *tilepicker_first (void);
 extern const struct tilepicker *tilepicker_next  (void);
+
+// Approximate number of window pixels covered by a tile returned by the
+// iterator above.
+extern uint32_t tilepicker_coverage (const struct tilepicker *tile);
+
+// Changes relative to the previous result. The serial number increases with
+// every result, so a user can tell whether it has already seen the changes.
+// For a tile returned by the iterator, tilepicker_previous() gives its
+// position in the iteration order of the previous result, or -1 if the tile
+// has just entered the visible set.
+extern uint32_t tilepicker_serial (void);
+extern int32_t  tilepicker_previous (const struct tilepicker *tile);
+
+// Tiles that have left the visible set with the current result.
+extern const struct tilepicker *tilepicker_left (size_t *n);
+
+extern void tilepicker_destroy (void);
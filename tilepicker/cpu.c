@@ -0,0 +1,401 @@
+// Select visible tiles without a GL context, by traversing the tile quadtree
+// from the root. The four children of a node are evaluated together, one per
+// vector lane. Each child is bounded by a sphere that is culled against the
+// sides of the view frustum and against the horizon. Visible children are
+// refined while their zoom level is lower than the level requested by the
+// same zoomlevel() metric as the tilepicker shader, evaluated at the closest
+// point of the bounding sphere, which is where the shader would find the
+// highest zoom level for that tile.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../matrix.h"
+#include "../vec.h"
+#include "local.h"
+
+#define ZOOM_MAX	19
+
+// Bounding spheres are built from a few points on each tile. Inflate them to
+// contain the surface between those points. Below ZOOM_BULGE, the points are
+// so far apart that the surface bulges out by up to RADIUS_BULGE between them:
+#define RADIUS_SLACK	1.1f
+#define RADIUS_BULGE	0.3f
+#define ZOOM_BULGE	3
+
+// Four sibling tiles or points, one per vector lane:
+struct quad {
+	union vec x;
+	union vec y;
+	union vec z;
+};
+
+// View parameters for the current recalculation. Positions are relative to
+// the camera, so that single precision suffices at high zoom levels:
+static struct {
+	double    cam[3];
+	union vec plane_n[4];
+	union vec cam_pos;
+	union vec fwd;
+	union vec right;
+	float     cam_len;
+	float     altitude;
+	float     horizon;
+	float     alpha;
+	float     tan_alpha;
+	float     tan_arc;
+	float     pixel_sr;
+	float     pixels;
+} view;
+
+// Destination of the selected tiles:
+static void (* sink) (const struct tilepicker *tile, const uint32_t coverage, void *arg);
+static void *sink_arg;
+
+static inline union vec
+quad_dot (const struct quad *a, const struct quad *b)
+{
+	return vec_add3(vec_mul(a->x, b->x), vec_mul(a->y, b->y), vec_mul(a->z, b->z));
+}
+
+// Dot product of every lane with a single 3D vector:
+static inline union vec
+quad_dot1 (const struct quad *a, const union vec b)
+{
+	return vec_add3(vec_mul(a->x, vec_1(b.x)), vec_mul(a->y, vec_1(b.y)), vec_mul(a->z, vec_1(b.z)));
+}
+
+static inline struct quad
+quad_sub (const struct quad *a, const struct quad *b)
+{
+	return (struct quad) {
+		.x = vec_sub(a->x, b->x),
+		.y = vec_sub(a->y, b->y),
+		.z = vec_sub(a->z, b->z),
+	};
+}
+
+static inline struct quad
+quad_cross (const struct quad *a, const struct quad *b)
+{
+	return (struct quad) {
+		.x = vec_sub(vec_mul(a->y, b->z), vec_mul(a->z, b->y)),
+		.y = vec_sub(vec_mul(a->z, b->x), vec_mul(a->x, b->z)),
+		.z = vec_sub(vec_mul(a->x, b->y), vec_mul(a->y, b->x)),
+	};
+}
+
+static inline union vec
+lane_max (const union vec a, const union vec b)
+{
+	union vec r;
+
+	for (int i = 0; i < 4; i++)
+		r.elem.f[i] = a.elem.f[i] > b.elem.f[i] ? a.elem.f[i] : b.elem.f[i];
+
+	return r;
+}
+
+static inline union vec
+lane_sqrt (const union vec a)
+{
+	return vec(sqrtf(a.x), sqrtf(a.y), sqrtf(a.z), sqrtf(a.w));
+}
+
+// Point of the view frustum in view space, mapped to a direction in model
+// space. This is the same construction as in the tilepicker vertex shader:
+static void
+frustum_ray (const struct viewport *vp, const double x, const double y, const double z, double *ray)
+{
+	double out[4];
+
+	mat_vec64_multiply(out, vp->invert64.modelview, (double[4]) { x, y, z, 1.0 });
+
+	for (int i = 0; i < 3; i++)
+		ray[i] = out[i] - view.cam[i];
+}
+
+static void
+cross64 (double *r, const double *a, const double *b)
+{
+	r[0] = a[1] * b[2] - a[2] * b[1];
+	r[1] = a[2] * b[0] - a[0] * b[2];
+	r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static union vec
+normalize64 (const double *a)
+{
+	const double len = sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+
+	return vec(a[0] / len, a[1] / len, a[2] / len, 0.0f);
+}
+
+static void
+view_setup (const struct viewport *vp, const struct camera *cam)
+{
+	const double vp_angle = TILEPICKER_ANGLE(cam);
+	const double alpha    = vp_angle / 2.0;
+	const double aspect   = (double) vp->height / vp->width;
+	double corner[4][3], fwd[3], right[3];
+
+	for (int i = 0; i < 3; i++)
+		view.cam[i] = (double) vp->cam_pos[i] + vp->cam_pos_lowbits[i];
+
+	const double cam_len2 = view.cam[0] * view.cam[0]
+	                      + view.cam[1] * view.cam[1]
+	                      + view.cam[2] * view.cam[2];
+
+	view.cam_pos   = vec(view.cam[0], view.cam[1], view.cam[2], 0.0f);
+	view.cam_len   = sqrt(cam_len2);
+	view.altitude  = sqrt(cam_len2) - 1.0;
+	view.horizon   = cam_len2 - 1.0;
+	view.alpha     = alpha;
+	view.tan_alpha = tan(alpha);
+	view.tan_arc   = tan(vp_angle / vp->width);
+	view.pixel_sr  = pow(vp_angle / vp->width, 2.0);
+	view.pixels    = (float) vp->width * vp->height;
+
+	// Viewing direction and horizontal axis:
+	frustum_ray(vp, 0.0, 0.0, -1.0, fwd);
+	frustum_ray(vp, 1.0, 0.0,  0.0, right);
+	view.fwd   = normalize64(fwd);
+	view.right = normalize64(right);
+
+	// Rays through the corners of the image, counterclockwise:
+	static const double sx[4] = { -1.0,  1.0, 1.0, -1.0 };
+	static const double sy[4] = { -1.0, -1.0, 1.0,  1.0 };
+
+	for (int i = 0; i < 4; i++)
+		frustum_ray(vp, sx[i] * sin(alpha), sy[i] * sin(alpha) * aspect, -cos(alpha), corner[i]);
+
+	// Inward facing normals of the side planes through the camera:
+	for (int i = 0; i < 4; i++) {
+		double n[3];
+
+		cross64(n, corner[i], corner[(i + 1) % 4]);
+
+		if (n[0] * fwd[0] + n[1] * fwd[1] + n[2] * fwd[2] < 0.0)
+			for (int j = 0; j < 3; j++)
+				n[j] = -n[j];
+
+		view.plane_n[i] = normalize64(n);
+	}
+}
+
+// Sample a node on a 5x5 grid at two zoom levels down, so that each child is
+// a 3x3 subgrid of its corners, edge midpoints and center. The mapping is the
+// same as in globe.c. Also return the mercator y of the grid rows:
+static void
+grid (const uint32_t x, const uint32_t y, const uint32_t zoom, float g[3][5][5], double gy[5])
+{
+	double sin_lon[5], cos_lon[5], sech_gy[5], tanh_gy[5];
+
+	for (int i = 0; i < 5; i++) {
+		const double lon = M_PI * (ldexp(4 * x + i, -1 - (int) zoom) - 1.0);
+
+		gy[i] = M_PI * (1.0 - ldexp(4 * y + i, -1 - (int) zoom));
+		sincos(lon, &sin_lon[i], &cos_lon[i]);
+		sech_gy[i] = 1.0 / cosh(gy[i]);
+		tanh_gy[i] = tanh(gy[i]);
+	}
+
+	for (int row = 0; row < 5; row++)
+		for (int col = 0; col < 5; col++) {
+			g[0][row][col] = sin_lon[col] * sech_gy[row] - view.cam[0];
+			g[1][row][col] = tanh_gy[row]                - view.cam[1];
+			g[2][row][col] = cos_lon[col] * sech_gy[row] - view.cam[2];
+		}
+}
+
+// Gather one point of the 3x3 subgrid of each child. The lanes hold the
+// children in the order northwest, northeast, southwest, southeast:
+static inline struct quad
+gather (float g[3][5][5], const int row, const int col)
+{
+	struct quad q;
+	union vec *v[3] = { &q.x, &q.y, &q.z };
+
+	for (int i = 0; i < 3; i++)
+		*v[i] = vec(g[i][row][col],     g[i][row][col + 2],
+		            g[i][row + 2][col], g[i][row + 2][col + 2]);
+
+	return q;
+}
+
+// The highest zoom level that the tilepicker shader would request for any
+// point of the bounding spheres. The shader's metric is:
+//
+//   dx   = dist * tan(arc) / cos(look)
+//   zoom = int((-log2(dx) - 4.5) * (1 - abs(lat) / 12))
+//
+// which increases with decreasing distance, latitude and look angle, so each
+// of these is taken at its minimum over the sphere. The vector library has no
+// trigonometric or logarithmic functions, and approximations of them would let
+// the zoom levels drift from the shader's, so those run per lane:
+static inline void
+zoomlevel (const struct quad *c, const union vec dist, const union vec radius, const union vec lat, int want[4])
+{
+	const union vec h_x   = quad_dot1(c, view.right);
+	const union vec h_z   = quad_dot1(c, view.fwd);
+	const union vec ratio = vec_div(radius, dist);
+	const union vec scale = vec_sub(vec_1(1.0f), vec_div(lat, vec_1(12.0f)));
+	union vec near = vec_sub(dist, radius);
+	union vec cos_look;
+
+	for (int i = 0; i < 4; i++) {
+
+		// Closest distance, not closer than the ground below the camera:
+		near.elem.f[i] = fmaxf(near.elem.f[i], view.altitude);
+
+		// Smallest horizontal angle from the viewing direction. The
+		// shader interpolates the look angle linearly across the image:
+		const float rho = asinf(fminf(ratio.elem.f[i], 1.0f));
+		const float h   = fmaxf(atan2f(fabsf(h_x.elem.f[i]), h_z.elem.f[i]) - rho, 0.0f);
+
+		cos_look.elem.f[i] = h < view.alpha
+			? cosf(view.alpha * tanf(h) / view.tan_alpha)
+			: cosf(view.alpha);
+	}
+
+	const union vec dx = vec_div(vec_mul(near, vec_1(view.tan_arc)), cos_look);
+
+	for (int i = 0; i < 4; i++) {
+		const int zoom = (-log2f(dx.elem.f[i]) - 4.5f) * scale.elem.f[i];
+
+		want[i] = zoom < 0 ? 0 : zoom > ZOOM_MAX ? ZOOM_MAX : zoom;
+	}
+}
+
+// Add a tile, or the ancestor at the zoom level that it requests:
+static void
+emit (const uint32_t x, const uint32_t y, const uint32_t zoom, const int want, const float coverage)
+{
+	const uint32_t shift = (int) zoom > want ? zoom - want : 0;
+
+	sink(&(struct tilepicker) {
+		.x    = x >> shift,
+		.y    = y >> shift,
+		.zoom = zoom - shift,
+	}, coverage, sink_arg);
+}
+
+static void
+visit (const uint32_t x, const uint32_t y, const uint32_t zoom)
+{
+	const uint32_t child = zoom + 1;
+	float g[3][5][5];
+	double gy[5];
+	struct quad p[9];
+	int want[4];
+
+	grid(x, y, zoom, g, gy);
+
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 3; col++)
+			p[row * 3 + col] = gather(g, row, col);
+
+	// Bounding sphere center, as the mean of the sample points:
+	struct quad c = p[0];
+
+	for (int i = 1; i < 9; i++) {
+		c.x = vec_add(c.x, p[i].x);
+		c.y = vec_add(c.y, p[i].y);
+		c.z = vec_add(c.z, p[i].z);
+	}
+
+	c.x = vec_div(c.x, vec_1(9.0f));
+	c.y = vec_div(c.y, vec_1(9.0f));
+	c.z = vec_div(c.z, vec_1(9.0f));
+
+	// Radius, as the largest distance to a sample point:
+	union vec r2 = vec_zero();
+
+	for (int i = 0; i < 9; i++) {
+		const struct quad d = quad_sub(&p[i], &c);
+		r2 = lane_max(r2, quad_dot(&d, &d));
+	}
+
+	const union vec radius = vec_add(vec_mul(lane_sqrt(r2), vec_1(RADIUS_SLACK)),
+	                                 vec_1(child < ZOOM_BULGE ? RADIUS_BULGE : 0.0f));
+	const union vec dist   = lane_sqrt(quad_dot(&c, &c));
+
+	// Smallest absolute mercator y over the rows of the children:
+	const float lat[2] = {
+		gy[0] * gy[2] <= 0.0 ? 0.0 : fmin(fabs(gy[0]), fabs(gy[2])),
+		gy[2] * gy[4] <= 0.0 ? 0.0 : fmin(fabs(gy[2]), fabs(gy[4])),
+	};
+
+	zoomlevel(&c, dist, radius, vec(lat[0], lat[0], lat[1], lat[1]), want);
+
+	// Cull against the horizon: the sphere must reach beyond the tangent
+	// plane of the globe at the horizon, (c + cam) . cam + r |cam| >= 1:
+	union vec visible = vec_add3(quad_dot1(&c, view.cam_pos), vec_1(view.horizon), vec_mul(radius, vec_1(view.cam_len)));
+
+	// Cull against the sides of the view frustum, n . c >= -r:
+	union vec inside[4];
+
+	for (int i = 0; i < 4; i++)
+		inside[i] = vec_add(quad_dot1(&c, view.plane_n[i]), radius);
+
+	// Approximate window coverage from the solid angle of the tile, which
+	// is the area of the quad spanned by its diagonals, projected on the
+	// view direction, over the squared distance:
+	const struct quad d1 = quad_sub(&p[8], &p[0]);
+	const struct quad d2 = quad_sub(&p[2], &p[6]);
+	const struct quad n  = quad_cross(&d1, &d2);
+	const union vec dist3 = vec_mul(dist, vec_square(dist));
+	const union vec solid = vec_div(quad_dot(&n, &c), vec_mul(vec_1(2.0f), dist3));
+	const union vec cover = vec_div(solid, vec_1(view.pixel_sr));
+
+	for (int i = 0; i < 4; i++) {
+		const uint32_t cx = 2 * x + (i & 1);
+		const uint32_t cy = 2 * y + (i >> 1);
+
+		if (visible.elem.f[i] < 0.0f)
+			continue;
+
+		if (inside[0].elem.f[i] < 0.0f || inside[1].elem.f[i] < 0.0f
+		 || inside[2].elem.f[i] < 0.0f || inside[3].elem.f[i] < 0.0f)
+			continue;
+
+		if (want[i] > (int) child) {
+			visit(cx, cy, child);
+			continue;
+		}
+
+		const float coverage = fabsf(cover.elem.f[i]);
+
+		emit(cx, cy, child, want[i],
+			coverage < 1.0f ? 1.0f :
+			coverage > view.pixels ? view.pixels : coverage);
+	}
+}
+
+static void
+bucket_add (const struct tilepicker *tile, const uint32_t coverage, void *arg)
+{
+	(void) arg;
+
+	tilepicker_bucket_add(tile, coverage);
+}
+
+void
+tilepicker_cpu_select (const struct viewport *vp, const struct camera *cam, void (* cb) (const struct tilepicker *, const uint32_t, void *), void *arg)
+{
+	sink     = cb;
+	sink_arg = arg;
+	view_setup(vp, cam);
+
+	// The root tile is always refined:
+	visit(0, 0, 0);
+}
+
+void
+tilepicker_cpu_recalc (const struct viewport *vp, const struct camera *cam)
+{
+	tilepicker_buckets_reset();
+	tilepicker_cpu_select(vp, cam, bucket_add, NULL);
+	tilepicker_buckets_commit();
+}
@@ -0,0 +1,420 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <GL/gl.h>
+
+#include "../camera.h"
+#include "../glutil.h"
+#include "../program.h"
+#include "../program/tilepicker.h"
+#include "../util.h"
+#include "local.h"
+
+// Number of readbacks that can be in flight:
+#define READBACK_SLOTS	3
+
+// Window pixels between samples at quality 1, and the range of image sizes:
+#define SAMPLE_SPACING	16.0
+#define IMGSIZE_MIN	16
+#define IMGSIZE_MAX	256
+
+// Subdivision of a coarse cell in the refinement pass:
+#define REFINE		4
+
+struct pixel {
+	struct tilepicker tile;
+	uint32_t valid;
+} __attribute__((packed));
+
+struct size {
+	uint32_t width;
+	uint32_t height;
+};
+
+// The tilepicker image is read back asynchronously into a ring of pixel pack
+// buffers. Each readback is followed by a fence, and its result is consumed on
+// a later frame once the fence has signaled. Until then, the previous set of
+// visible tiles stays in use. The image size can change between readbacks, so
+// each slot records the layout of its contents:
+static struct {
+	struct slot {
+		GLuint      pbo;
+		GLsizeiptr  bytes;
+		GLsync      fence;
+		struct size size;
+		bool        refine;
+		uint32_t    weight;
+	} slot[READBACK_SLOTS];
+	uint32_t tail;
+	uint32_t count;
+	bool     valid;
+} readback;
+
+// Image sampling settings:
+static struct {
+	float quality;
+	bool  refine;
+} config = {
+	.quality = 1.0f,
+	.refine  = false,
+};
+
+// Coarse and refined images, and the current coarse image size:
+static GLuint tex[2];
+static struct size size;
+
+static GLuint vao;
+static GLuint vbo;
+static GLuint fbo;
+static GLint fb_orig[2];
+static GLint vp_orig[4];
+
+static void fbo_bind (void)
+{
+	// Save current framebuffer bindings to restore them later:
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fb_orig[0]);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &fb_orig[1]);
+
+	// Save original viewport dimensions:
+	glutil_viewport_get(vp_orig);
+
+	// Bind own framebuffer for drawing and reading:
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+}
+
+static void fbo_unbind (void)
+{
+	// Restore original viewport dimensions:
+	glutil_viewport(vp_orig[0], vp_orig[1], vp_orig[2], vp_orig[3]);
+
+	// Restore original framebuffer bindings:
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fb_orig[0]);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fb_orig[1]);
+}
+
+static bool
+init (void)
+{
+	const GLint loc = program_tilepicker_loc_vertex();
+	static const struct glutil_vertex verts[4] = {
+		[0] = { -1.0, -1.0 },
+		[1] = {  1.0, -1.0 },
+		[2] = {  1.0,  1.0 },
+		[3] = { -1.0,  1.0 },
+	};
+
+	// The program is built lazily, and may fail:
+	if (loc < 0)
+		return false;
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glGenFramebuffers(1, &fbo);
+
+	glutil_vertex_array(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+	// Map 'vertex' attribute to a member of struct glutil_vertex:
+	glutil_vertex_link(loc);
+
+	// Copy vertices to buffer:
+	glBufferData(GL_ARRAY_BUFFER, sizeof (verts), verts, GL_STATIC_DRAW);
+
+	// Unbind array:
+	glutil_vertex_array(0);
+
+	// Create the readback buffers, which are sized on first use:
+	for (int i = 0; i < READBACK_SLOTS; i++)
+		glGenBuffers(1, &readback.slot[i].pbo);
+
+	return true;
+}
+
+// Choose the image size. By default, there is one sample for every 16 window
+// pixels. A tilted camera compresses the far field vertically, so sample
+// more rows as the tilt increases:
+static struct size
+size_choose (const struct viewport *vp, const struct camera *cam)
+{
+	const double spacing = SAMPLE_SPACING / config.quality;
+	const double tilt    = 1.0 / fmax(cos(cam->tilt), 0.25);
+	const double dim[2]  = {
+		vp->width  / spacing,
+		vp->height / spacing * tilt,
+	};
+
+	uint32_t clamped[2];
+
+	for (int i = 0; i < 2; i++)
+		clamped[i] = dim[i] < IMGSIZE_MIN ? IMGSIZE_MIN
+		           : dim[i] > IMGSIZE_MAX ? IMGSIZE_MAX
+		           : (uint32_t) lround(dim[i]);
+
+	return (struct size) { clamped[0], clamped[1] };
+}
+
+// Reallocate the coarse and refined images when the size changes:
+static void
+size_update (const struct size new)
+{
+	if (new.width == size.width && new.height == size.height)
+		return;
+
+	// Deleting the textures unbinds them, so forget the cached bindings:
+	if (tex[0] != 0) {
+		glDeleteTextures(2, tex);
+		glutil_state_reset();
+	}
+
+	size = new;
+	glGenTextures(2, tex);
+
+	for (int i = 0; i < 2; i++) {
+		const uint32_t scale = i ? REFINE : 1;
+
+		glutil_texture(0, GL_TEXTURE_2D, tex[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32UI, size.width * scale, size.height * scale);
+	}
+
+	glutil_texture(0, GL_TEXTURE_2D, 0);
+}
+
+// Drop the oldest readback from the ring:
+static void
+readback_drop (void)
+{
+	glDeleteSync(readback.slot[readback.tail].fence);
+	readback.tail = (readback.tail + 1) % READBACK_SLOTS;
+	readback.count--;
+}
+
+// Claim the next free slot for a readback. If all slots are in use, the
+// oldest readback is superseded by this one:
+static struct slot *
+readback_slot (const struct viewport *vp)
+{
+	if (readback.count == READBACK_SLOTS)
+		readback_drop();
+
+	struct slot *s = &readback.slot[(readback.tail + readback.count++) % READBACK_SLOTS];
+	const GLsizeiptr pixels = size.width * size.height * (config.refine ? 1 + REFINE * REFINE : 1);
+
+	s->size   = size;
+	s->refine = config.refine;
+
+	// Number of window pixels represented by one coarse sample:
+	s->weight = (uint32_t) vp->width * vp->height / (size.width * size.height);
+
+	// Grow the buffer if needed:
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+
+	if (s->bytes < pixels * (GLsizeiptr) sizeof (struct pixel)) {
+		s->bytes = pixels * sizeof (struct pixel);
+		glBufferData(GL_PIXEL_PACK_BUFFER, s->bytes, NULL, GL_STREAM_READ);
+	}
+
+	return s;
+}
+
+// Draw one pass of the tilepicker image and read it back into the bound pack
+// buffer at the given offset:
+static void
+pass (const int i, const size_t offset)
+{
+	const uint32_t scale = i ? REFINE : 1;
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex[i], 0);
+	glutil_viewport(0, 0, size.width * scale, size.height * scale);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glutil_vertex_array(vao);
+	glutil_draw_quad();
+	glutil_vertex_array(0);
+
+	// With a pack buffer bound, the data pointer is a buffer offset:
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, size.width * scale, size.height * scale, GL_RGBA_INTEGER, GL_UNSIGNED_INT, (void *) offset);
+}
+
+static void
+render (const struct viewport *vp, const struct camera *cam)
+{
+	struct program_tilepicker values = {
+		.vp_angle   = TILEPICKER_ANGLE(cam),
+		.vp_height  = vp->height,
+		.vp_width   = vp->width,
+		.refine     = 0,
+	};
+
+	// Skip the frame if the program failed to build:
+	if (program_tilepicker_use(&values) == false)
+		return;
+
+	size_update(size_choose(vp, cam));
+
+	struct slot *s = readback_slot(vp);
+
+	// Use framebuffer object:
+	fbo_bind();
+
+	// Draw the coarse image:
+	pass(0, 0);
+
+	// Optionally sample the cells whose neighbours disagree on the zoom
+	// level at a higher resolution. The coarse image is no longer
+	// attached, so it can be sampled:
+	if (s->refine) {
+		values.refine = REFINE;
+		glutil_texture(0, GL_TEXTURE_2D, tex[0]);
+		program_tilepicker_use(&values);
+		pass(1, size.width * size.height * sizeof (struct pixel));
+		glutil_texture(0, GL_TEXTURE_2D, 0);
+	}
+
+	program_none();
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	fbo_unbind();
+
+	s->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+static inline uint32_t
+clamp (const int32_t v, const uint32_t max)
+{
+	return v < 0 ? 0 : (uint32_t) v >= max ? max - 1 : (uint32_t) v;
+}
+
+// Check whether a coarse cell has the same zoom level and validity as its
+// direct neighbours. This is the same test as in the fragment shader:
+static bool
+cell_stable (const struct pixel *img, const struct size *sz, const int32_t x, const int32_t y)
+{
+	static const int32_t dx[4] = { -1, 1,  0, 0 };
+	static const int32_t dy[4] = {  0, 0, -1, 1 };
+	const struct pixel *c = &img[y * sz->width + x];
+
+	for (int i = 0; i < 4; i++) {
+		const uint32_t nx = clamp(x + dx[i], sz->width);
+		const uint32_t ny = clamp(y + dy[i], sz->height);
+		const struct pixel *n = &img[ny * sz->width + nx];
+
+		if (n->tile.zoom != c->tile.zoom || n->valid != c->valid)
+			return false;
+	}
+
+	return true;
+}
+
+static void
+populate_buckets (const struct slot *s, const struct pixel *img)
+{
+	const uint32_t fine = s->weight / (REFINE * REFINE);
+
+	// Reset buckets:
+	tilepicker_buckets_reset();
+
+	// Loop over all pixels in the coarse image, add to bucket. Cells that
+	// were refined are covered by the refined image:
+	for (uint32_t y = 0; y < s->size.height; y++)
+		for (uint32_t x = 0; x < s->size.width; x++) {
+			const struct pixel *p = &img[y * s->size.width + x];
+
+			if (p->valid == 0)
+				continue;
+
+			if (s->refine && cell_stable(img, &s->size, x, y) == false)
+				continue;
+
+			tilepicker_bucket_add(&p->tile, s->weight);
+		}
+
+	// Add the pixels of the refined image:
+	if (s->refine)
+		FOREACH_NELEM (img + s->size.width * s->size.height, s->size.width * s->size.height * REFINE * REFINE, p)
+			if (p->valid)
+				tilepicker_bucket_add(&p->tile, fine ? fine : 1);
+
+	tilepicker_buckets_commit();
+}
+
+// Check whether the readback in a slot is complete, optionally waiting:
+static bool
+readback_done (const struct slot *s, const bool wait)
+{
+	const GLuint64 timeout = wait ? 1000000000 : 0;
+
+	switch (glClientWaitSync(s->fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout)) {
+	case GL_ALREADY_SIGNALED:
+	case GL_CONDITION_SATISFIED:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// Fill the buckets from the newest completed readback, and drop all older
+// readbacks. Fences signal in order, so search from newest to oldest:
+static void
+readback_poll (const bool wait)
+{
+	for (uint32_t i = readback.count; i > 0; i--) {
+		const struct slot *s = &readback.slot[(readback.tail + i - 1) % READBACK_SLOTS];
+		const struct pixel *img;
+
+		if (readback_done(s, wait && i == readback.count) == false)
+			continue;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+
+		if ((img = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, s->bytes, GL_MAP_READ_BIT)) != NULL) {
+			populate_buckets(s, img);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			readback.valid = true;
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		while (i-- > 0)
+			readback_drop();
+
+		return;
+	}
+}
+
+void
+tilepicker_gpu_set_quality (const float quality, const bool refine)
+{
+	config.quality = quality;
+	config.refine  = refine;
+}
+
+void
+tilepicker_gpu_recalc (const struct viewport *vp, const struct camera *cam)
+{
+	static bool init_done = false;
+
+	// Lazy init. Without the program, no tiles are picked:
+	if (init_done == false) {
+		if (init() == false)
+			return;
+
+		init_done = true;
+	}
+
+	// Render tile zoom info to buffer and start reading it back:
+	render(vp, cam);
+}
+
+bool
+tilepicker_gpu_update (void)
+{
+	if (readback.count == 0)
+		return false;
+
+	// Wait for the very first result, because there is no previous set
+	// of visible tiles to fall back to:
+	readback_poll(readback.valid == false);
+	return readback.count > 0;
+}
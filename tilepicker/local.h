@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../tilepicker.h"
+
+// The tilepicker looks slightly beyond the edges of the viewport, so that tiles
+// are selected just before they come into view:
+#define TILEPICKER_ANGLE(cam)	((cam)->view_angle * 66.0 / 64.0)
+
+// Backends. Both fill the buckets through tilepicker_bucket_add().
+extern void tilepicker_gpu_recalc (const struct viewport *vp, const struct camera *cam);
+extern bool tilepicker_gpu_update (void);
+extern void tilepicker_gpu_set_quality (const float quality, const bool refine);
+extern void tilepicker_cpu_recalc (const struct viewport *vp, const struct camera *cam);
+extern void tilepicker_cpu_select (const struct viewport *vp, const struct camera *cam, void (* cb) (const struct tilepicker *, const uint32_t, void *), void *arg);
+
+// Start a new result with empty buckets, add a tile that covers a number of
+// window pixels, and publish the result when all tiles have been added.
+extern void tilepicker_buckets_reset  (void);
+extern void tilepicker_bucket_add     (const struct tilepicker *tile, const uint32_t coverage);
+extern void tilepicker_buckets_commit (void);
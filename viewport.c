@@ -3,6 +3,7 @@
 #include <GL/gl.h>
 #include <GL/glu.h>
 
+#include "glutil.h"
 #include "globe.h"
 #include "camera.h"
 #include "tilepicker.h"
@@ -14,11 +15,46 @@
 // Screen dimensions:
 static struct viewport vp;
 
+// Contents of the uniform block shared by all programs, in std140 layout.
+// Each vec3 is padded to a vec4 by the float that follows it:
+static struct {
+	float mat_mvp_origin[16];
+	float mat_mv_inv[16];
+	float cam[3];
+	float view_angle;
+	float cam_lowbits[3];
+	float view_width;
+	float view_height;
+	float pad[3];
+} block;
+
+static GLuint ubo;
+
+// Upload the viewport state once for all programs:
+static void
+block_update (const struct camera *cam)
+{
+	memcpy(block.mat_mvp_origin, vp.matrix32.modelviewproj_origin, sizeof (block.mat_mvp_origin));
+	memcpy(block.mat_mv_inv,     vp.invert32.modelview,            sizeof (block.mat_mv_inv));
+	memcpy(block.cam,            vp.cam_pos,                       sizeof (block.cam));
+	memcpy(block.cam_lowbits,    vp.cam_pos_lowbits,               sizeof (block.cam_lowbits));
+
+	block.view_angle  = cam->view_angle;
+	block.view_width  = vp.width;
+	block.view_height = vp.height;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof (block), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 void
 viewport_destroy (void)
 {
 	layers_destroy();
 	programs_destroy();
+	tilepicker_destroy();
+	glDeleteBuffers(1, &ubo);
 }
 
 bool
@@ -50,13 +86,18 @@ viewport_unproject (const struct viewport_pos *pos, float *lat, float *lon)
 	return globe_intersect(&p1, &dir, lat, lon);
 }
 
-void
+bool
 viewport_paint (void)
 {
+	bool pending;
+
+	// Start with no assumptions about the GL state:
+	glutil_state_frame();
+
 	// Clear the depth buffer:
+	glutil_depth_mask(true);
 	glClear(GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
-	glDepthMask(GL_TRUE);
+	glutil_depth_test(true);
 
 	const struct camera *cam  = camera_get();
 	const struct globe *globe = globe_get();
@@ -110,16 +151,23 @@ viewport_paint (void)
 
 	if (globe->updated.model || cam->updated.proj || cam->updated.view) {
 
+		// Share the new state with all programs:
+		block_update(cam);
+
 		// Recalculate the list of visible tiles:
 		tilepicker_recalc(&vp, cam);
 	}
 
+	// Pick up the list of visible tiles from an earlier recalculation:
+	pending = tilepicker_update();
+
 	// Reset matrix update flags:
 	camera_updated_reset();
 	globe_updated_reset();
 
 	// Paint all layers:
 	layers_paint(camera_get(), &vp);
+	return pending;
 }
 
 void
@@ -129,7 +177,7 @@ viewport_resize (const unsigned int width, const unsigned int height)
 	vp.height = height;
 
 	// Setup viewport:
-	glViewport(0, 0, vp.width, vp.height);
+	glutil_viewport(0, 0, vp.width, vp.height);
 
 	// Update camera's projection matrix:
 	camera_set_aspect_ratio(&vp);
@@ -153,6 +201,13 @@ viewport_init (const uint32_t width, const uint32_t height)
 	if (!programs_init())
 		return false;
 
+	// Create the uniform buffer and attach it to the shared binding point:
+	glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof (block), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, PROGRAMS_BLOCK_VIEWPORT, ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
 	if (!layers_init(&vp))
 		return false;
 
@@ -57,7 +57,9 @@ struct viewport_pos {
 extern void viewport_destroy (void);
 extern bool viewport_unproject (const struct viewport_pos *p, float *lat, float *lon);
 extern void viewport_resize (const uint32_t wd, const uint32_t ht);
-extern void viewport_paint (void);
+// Paint the frame. Returns true if the frame is incomplete and another frame
+// should be painted soon.
+extern bool viewport_paint (void);
 
 extern const struct viewport *viewport_get (void);
 extern bool viewport_init (const uint32_t width, const uint32_t height);
@@ -85,3 +85,14 @@ zoom_in (const int64_t now)
 	state.zooming.start = now;
 	state.zooming.goal  = zoomlevel_to_distance(++state.zoom);
 }
+
+bool
+zoom_predict (double *distance)
+{
+	if (state.state != STATE_ZOOMING)
+		return false;
+
+	// The zoom reaches its goal within half a second:
+	*distance = state.zooming.goal;
+	return true;
+}
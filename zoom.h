@@ -6,3 +6,7 @@
 extern bool zoom_on_tick (const int64_t now);
 extern void zoom_out     (const int64_t now);
 extern void zoom_in      (const int64_t now);
+
+// Get the camera distance that a zoom in progress is heading to. Returns false
+// if the camera is not zooming.
+extern bool zoom_predict (double *distance);